@@ -1,64 +1,329 @@
 #include "encoder_driver.h"
+#include "ky040_priv.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
+#include "freertos/task.h"
 #include "driver/gpio.h"
+#include "driver/gpio_filter.h"
+#include "soc/soc_caps.h"
 #include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_intr_alloc.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include <stdlib.h>
 
 #define KY040_TAG "KY040DRV"
 
+// Marks a transition where both CLK and DT changed at once (lost edge / noise)
+#define KY040_QUAD_ILLEGAL 2
+
+// Encoders serviced by the batched ISR (and any other all-encoder pass)
+#define KY040_MAX_ENCODERS     8
+
+// Edge timestamp ring used by ky040_get_velocity() (power of two)
+#define KY040_EDGE_RING        8
+// Below this edge period the estimate averages the whole ring instead of 1/T
+#define KY040_VEL_SWITCH_US    2000
+// No edge for this long reads as standstill
+#define KY040_VEL_TIMEOUT_US   500000
+
+// Sequence counter around every state update: odd while a write is in
+// progress, so readers can retry instead of masking interrupts.
+#define _seq_write_begin(e) do { (e)->seq++; __atomic_thread_fence(__ATOMIC_SEQ_CST); } while (0)
+#define _seq_write_end(e)   do { __atomic_thread_fence(__ATOMIC_SEQ_CST); (e)->seq++; } while (0)
+
 struct ky040_encoder {
     gpio_num_t clk, dt, sw;
-    volatile int32_t ticks;
+    uint32_t pin_mask;           // CLK | DT | SW bits in the GPIO word
+    bool gpio_isr;               // false: edges come from a backend (RMT)
+    void* backend;
+    void (*backend_del)(void* backend);
+    volatile uint32_t fed_us;    // backend: edges up to here have been fed (low 32 bits)
+    volatile uint32_t seq;       // see _seq_write_begin/_seq_write_end
+    volatile int64_t ticks;      // folded into [0, span) unless multi_turn
     volatile int64_t last_edge_us;
-    uint32_t debounce_us;
+    volatile uint32_t edges;     // accepted edges since create
+    uint32_t edge_us[KY040_EDGE_RING];   // low 32 bits of esp_timer time
+    int8_t   edge_dir[KY040_EDGE_RING];  // signed step of that edge
+    uint32_t debounce_us;        // current window, 0 when the hardware filter is in use
+    uint32_t debounce_min_us;    // adaptive window bounds, max == 0: fixed window
+    uint32_t debounce_max_us;
+    uint32_t edge_gap_avg_us;    // EMA of accepted X1 edge intervals
     bool reverse;
+    ky040_decode_t decode;
+    ky040_filter_t filter;
+    gpio_glitch_filter_handle_t glitch[2];   // CLK, DT (KY040_FILTER_HW)
+    uint8_t quad_state;          // last (CLK << 1) | DT, X4 mode only
+    // Health counters, see ky040_get_stats()
+    volatile uint32_t illegal;   // X4 transitions dropped as invalid
+    volatile uint32_t rejects;   // edges dropped by the debounce window
+    uint32_t min_gap_us;         // shortest interval between accepted edges
     uint16_t ang_min, ang_max;   // inclusive
     uint16_t span;               // (ang_max - ang_min + 1)
+    bool multi_turn;             // ticks never fold, angle from deg_q32
+    uint64_t deg_q32;            // multi_turn: output degrees per tick, Q32
     portMUX_TYPE mux;
+    ky040_snapshot_t latch;      // filled by ky040_latch_all()
+    // Change notification, coalesced: fires once, re-armed by the next read
+    ky040_change_cb_t on_change;
+    void* user_ctx;
+    TaskHandle_t notify_task;
+    volatile bool armed;
+    // SW input: zero button or homing index/limit switch
+    ky040_sw_mode_t sw_mode;
+    volatile bool index_armed;   // next SW edge latches index_ticks
+    volatile bool index_valid;
+    int64_t index_ticks;
+    int64_t index_us;
+    // ISR cost in CPU cycles, handler body only (excludes IDF dispatch)
+    uint32_t isr_cyc_max;
+    uint32_t isr_calls;
+    uint64_t isr_cyc_sum;
 };
 
 static bool s_isr_service_installed = false;
+static intr_handle_t s_batched_isr = NULL;
+
+static struct ky040_encoder* s_encoders[KY040_MAX_ENCODERS];
+static int s_encoder_count = 0;
+static portMUX_TYPE s_reg_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// ky040_latch_all(): one sequence counter for the whole latched vector
+static volatile uint32_t s_latch_seq = 0;
+static volatile int64_t s_latch_us = 0;
+
+// Indexed by (prev_state << 2) | cur_state, state = (CLK << 1) | DT.
+// CLK leading DT (00 -> 10 -> 11 -> 01 -> 00) counts up, matching the X1 sense.
+static const DRAM_ATTR int8_t s_quad_table[16] = {
+    0,                  -1,                 +1,                 KY040_QUAD_ILLEGAL,
+    +1,                 0,                  KY040_QUAD_ILLEGAL, -1,
+    -1,                 KY040_QUAD_ILLEGAL, 0,                  +1,
+    KY040_QUAD_ILLEGAL, +1,                 -1,                 0,
+};
+
+static inline bool IRAM_ATTR _debounce_ok(struct ky040_encoder* e, int64_t now) {
+    if (e->debounce_us == 0) return true;
+    return now - e->last_edge_us >= (int64_t)e->debounce_us;
+}
+
+// Window follows a quarter of the recent edge interval: wide for a slow
+// hand-turned knob, narrow enough for a fast shaft to keep every edge.
+// Shorter intervals are taken at once, longer ones are averaged in, so a
+// speed-up loses few edges and a single late edge does not open the window.
+static inline void IRAM_ATTR _debounce_adapt(struct ky040_encoder* e, int64_t now) {
+    if (e->debounce_max_us == 0) return;
+    int64_t gap = now - e->last_edge_us;
+    if (gap > 4 * (int64_t)e->debounce_max_us) gap = 4 * (int64_t)e->debounce_max_us;
+    int32_t avg = (int32_t)e->edge_gap_avg_us;
+    if (gap < avg) avg = (int32_t)gap;
+    else           avg += ((int32_t)gap - avg) >> 2;
+    e->edge_gap_avg_us = (uint32_t)avg;
+
+    uint32_t w = (uint32_t)avg >> 2;
+    if (w < e->debounce_min_us) w = e->debounce_min_us;
+    if (w > e->debounce_max_us) w = e->debounce_max_us;
+    e->debounce_us = w;
+}
+
+// (a * k) >> 16 for a signed tick count and a Q32 scale, built from 32x32->64
+// multiplies only (no 64-bit divide or multiply helpers on the RV32 core).
+// Exact while |a| < 2^32 * 2^15 / (k >> 32); any real shaft stays far below.
+static inline int64_t _mul_q32_shr16(int64_t a, uint64_t k) {
+    bool neg = a < 0;
+    uint64_t m = neg ? (uint64_t)0 - (uint64_t)a : (uint64_t)a;
+    uint32_t ah = (uint32_t)(m >> 32), al = (uint32_t)m;
+    uint32_t kh = (uint32_t)(k >> 32), kl = (uint32_t)k;
+    uint64_t r = ((uint64_t)al * kl) >> 16;
+    r += ((uint64_t)ah * kl + (uint64_t)al * kh) << 16;
+    r += ((uint64_t)ah * kh) << 48;
+    return neg ? -(int64_t)r : (int64_t)r;
+}
+
+static inline uint16_t _angle_mod(struct ky040_encoder* e, int64_t ticks) {
+    if (e->multi_turn) {
+        // No wrap: clamp the unwrapped output angle into the legacy range
+        int64_t deg = _mul_q32_shr16(ticks, e->deg_q32) >> 16;
+        if (deg < e->ang_min) deg = e->ang_min;
+        if (deg > e->ang_max) deg = e->ang_max;
+        return (uint16_t)deg;
+    }
+    // The ISR already keeps ticks in [0, span)
+    if (ticks < 0 || ticks >= e->span) ticks = 0;
+    return (uint16_t)(e->ang_min + ticks);
+}
 
-static inline bool _debounce_ok(volatile int64_t* last_us, uint32_t min_us) {
-    if (min_us == 0) return true;
+static inline uint8_t _quad_read(struct ky040_encoder* e) {
+    return (uint8_t)((gpio_get_level(e->clk) << 1) | gpio_get_level(e->dt));
+}
+
+static inline uint8_t IRAM_ATTR _quad_from_word(struct ky040_encoder* e, uint32_t in) {
+    return (uint8_t)((((in >> e->clk) & 1) << 1) | ((in >> e->dt) & 1));
+}
+
+static inline void IRAM_ATTR _notify(struct ky040_encoder* e) {
+    if (!e->armed) return;
+    e->armed = false;
+    if (!xPortInIsrContext()) {
+        // Backend decode runs in a task
+        if (e->notify_task) xTaskNotifyGive(e->notify_task);
+        if (e->on_change) e->on_change(e, e->user_ctx);
+        return;
+    }
+    BaseType_t hp_woken = pdFALSE;
+    if (e->notify_task) vTaskNotifyGiveFromISR(e->notify_task, &hp_woken);
+    if (e->on_change && e->on_change(e, e->user_ctx)) hp_woken = pdTRUE;
+    if (hp_woken) portYIELD_FROM_ISR();
+}
+
+// The decode helpers are reached from the IRAM ISRs and carry IRAM_ATTR in
+// case the compiler does not inline them. Notification is left to the
+// caller, so the batched ISR can signal after it leaves its critical section.
+static inline void IRAM_ATTR _ticks_add(struct ky040_encoder* e, int delta, int64_t now) {
+    if (e->reverse) delta = -delta;
+
+    portENTER_CRITICAL_SAFE(&e->mux);   // also reached from backend tasks
+    _seq_write_begin(e);
+    e->ticks += delta;
+    if (!e->multi_turn) {
+        if (e->ticks >= e->span) e->ticks -= e->span;
+        if (e->ticks < 0)        e->ticks += e->span;
+    }
+    uint32_t gap = (uint32_t)(now - e->last_edge_us);
+    if (gap < e->min_gap_us) e->min_gap_us = gap;
+    e->last_edge_us = now;
+    uint32_t slot = e->edges & (KY040_EDGE_RING - 1);
+    e->edge_us[slot]  = (uint32_t)now;
+    e->edge_dir[slot] = (int8_t)delta;
+    e->edges++;
+    _seq_write_end(e);
+    portEXIT_CRITICAL_SAFE(&e->mux);
+}
+
+static inline void IRAM_ATTR _isr_cycles(struct ky040_encoder* e, uint32_t start) {
+    uint32_t c = esp_cpu_get_cycle_count() - start;
+    if (c > e->isr_cyc_max) e->isr_cyc_max = c;
+    e->isr_cyc_sum += c;
+    e->isr_calls++;
+}
+
+// true if the count changed
+static inline bool IRAM_ATTR _clk_edge(struct ky040_encoder* e, int dt) {
     int64_t now = esp_timer_get_time();
-    if (now - *last_us < (int64_t)min_us) return false;
-    *last_us = now;
+    if (!_debounce_ok(e, now)) {
+        e->rejects++;
+        return false;
+    }
+
+    _debounce_adapt(e, now);
+    _ticks_add(e, (dt == 0) ? +1 : -1, now);
     return true;
 }
 
-static inline uint16_t _angle_mod(struct ky040_encoder* e, int32_t ticks) {
-    int32_t t = ticks % e->span;
-    if (t < 0) t += e->span;
-    return (uint16_t)(e->ang_min + t);
+static inline bool IRAM_ATTR _quad_edge_at(struct ky040_encoder* e, uint8_t cur, int64_t now) {
+    int8_t delta = s_quad_table[(e->quad_state << 2) | cur];
+    e->quad_state = cur;
+
+    if (delta == 0) return false;    // no state change, e.g. a bounce already settled
+    if (delta == KY040_QUAD_ILLEGAL) {
+        e->illegal++;
+        return false;
+    }
+    _ticks_add(e, delta, now);
+    return true;
+}
+
+static inline bool IRAM_ATTR _quad_edge(struct ky040_encoder* e, uint8_t cur) {
+    return _quad_edge_at(e, cur, esp_timer_get_time());
 }
 
 static void IRAM_ATTR ky040_isr_clk(void* arg) {
     struct ky040_encoder* e = (struct ky040_encoder*)arg;
-    if (!_debounce_ok(&e->last_edge_us, e->debounce_us)) return;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    bool changed = _clk_edge(e, gpio_get_level(e->dt));
+    _isr_cycles(e, c0);
+    if (changed) _notify(e);
+}
 
-    int dt = gpio_get_level(e->dt);
-    int delta = (dt == 0) ? +1 : -1;
-    if (e->reverse) delta = -delta;
+// X4: shared by CLK and DT, fires on any edge of either line
+static void IRAM_ATTR ky040_isr_quad(void* arg) {
+    struct ky040_encoder* e = (struct ky040_encoder*)arg;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    bool changed = _quad_edge(e, _quad_read(e));
+    _isr_cycles(e, c0);
+    if (changed) _notify(e);
+}
 
+// The index latch is taken in the same critical section as the count, so
+// it is the exact tick at the switch edge whatever the task side is doing.
+static inline void IRAM_ATTR _sw_edge(struct ky040_encoder* e) {
+    int64_t now = esp_timer_get_time();
     portENTER_CRITICAL_ISR(&e->mux);
-    e->ticks += delta;
-    if (e->ticks >= (int32_t)e->span) e->ticks -= e->span;
-    if (e->ticks < 0)                 e->ticks += e->span;
+    if (e->index_armed) {
+        e->index_ticks = e->ticks;
+        e->index_us    = now;
+        e->index_valid = true;
+        e->index_armed = false;
+    }
+    if (e->sw_mode == KY040_SW_ZERO) {
+        _seq_write_begin(e);
+        e->ticks = 0;
+        _seq_write_end(e);
+    }
     portEXIT_CRITICAL_ISR(&e->mux);
 }
 
 static void IRAM_ATTR ky040_isr_sw(void* arg) {
     struct ky040_encoder* e = (struct ky040_encoder*)arg;
-    portENTER_CRITICAL_ISR(&e->mux);
-    e->ticks = 0;
-    portEXIT_CRITICAL_ISR(&e->mux);
+    _sw_edge(e);
+    _notify(e);
+}
+
+// Batched mode: the only GPIO interrupt handler. One status read, one input
+// read, then every registered encoder is decoded from those two words.
+// Change callbacks run after the registry lock is released.
+static void IRAM_ATTR ky040_isr_batched(void* arg) {
+    (void)arg;
+    uint32_t status = REG_READ(GPIO_STATUS_REG);
+    REG_WRITE(GPIO_STATUS_W1TC_REG, status);
+    uint32_t in = REG_READ(GPIO_IN_REG);
+    struct ky040_encoder* changed[KY040_MAX_ENCODERS];
+    int n_changed = 0;
+
+    portENTER_CRITICAL_ISR(&s_reg_mux);
+    for (int i = 0; i < s_encoder_count; i++) {
+        struct ky040_encoder* e = s_encoders[i];
+        if (!(status & e->pin_mask)) continue;
+
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        bool moved = false;
+        if (e->decode == KY040_DECODE_X4) {
+            if (status & (BIT(e->clk) | BIT(e->dt))) moved = _quad_edge(e, _quad_from_word(e, in));
+        } else if (status & BIT(e->clk)) {
+            moved = _clk_edge(e, (in >> e->dt) & 1);
+        }
+        if (e->sw >= 0 && (status & BIT(e->sw)) && !(in & BIT(e->sw))) {
+            _sw_edge(e);
+            moved = true;
+        }
+        _isr_cycles(e, c0);
+        if (moved) changed[n_changed++] = e;
+    }
+    portEXIT_CRITICAL_ISR(&s_reg_mux);
+
+    for (int i = 0; i < n_changed; i++) _notify(changed[i]);
+}
+
+esp_err_t ky040_install_batched_isr(int intr_flags) {
+    if (s_batched_isr) return ESP_OK;
+    if (s_isr_service_installed) return ESP_ERR_INVALID_STATE;
+    return gpio_isr_register(ky040_isr_batched, NULL, intr_flags | ESP_INTR_FLAG_IRAM, &s_batched_isr);
 }
 
 esp_err_t ky040_install_isr_service_once(int intr_flags) {
+    if (s_batched_isr) return ESP_ERR_INVALID_STATE;
     if (s_isr_service_installed) return ESP_OK;
     esp_err_t err = gpio_install_isr_service(intr_flags);
     if (err == ESP_ERR_INVALID_STATE) {
@@ -69,39 +334,123 @@ esp_err_t ky040_install_isr_service_once(int intr_flags) {
     return err;
 }
 
+static esp_err_t _glitch_filter_add(gpio_num_t pin, gpio_glitch_filter_handle_t* out) {
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+    // Fixed two-clock-cycle window on the ESP32-C3: it rejects spikes before
+    // they raise an interrupt, not millisecond contact bounce.
+    gpio_pin_glitch_filter_config_t fcfg = {
+        .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+        .gpio_num = pin,
+    };
+    ESP_RETURN_ON_ERROR(gpio_new_pin_glitch_filter(&fcfg, out), KY040_TAG, "glitch filter");
+    return gpio_glitch_filter_enable(*out);
+#else
+    (void)pin; (void)out;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+static void _glitch_filter_del(gpio_glitch_filter_handle_t f) {
+    if (!f) return;
+    gpio_glitch_filter_disable(f);
+    gpio_del_glitch_filter(f);
+}
+
 esp_err_t ky040_create(const ky040_config_t* cfg, ky040_handle_t* out) {
+    return ky040_priv_create(cfg, true, out);
+}
+
+esp_err_t ky040_priv_create(const ky040_config_t* cfg, bool gpio_isr, ky040_handle_t* out) {
     if (!cfg || !out) return ESP_ERR_INVALID_ARG;
     if (cfg->angle_max < cfg->angle_min) return ESP_ERR_INVALID_ARG;
     uint32_t span = (uint32_t)cfg->angle_max - (uint32_t)cfg->angle_min + 1;
     if (span == 0 || span > 65535) return ESP_ERR_INVALID_ARG;
+    if (cfg->multi_turn && cfg->counts_per_rev == 0) return ESP_ERR_INVALID_ARG;
 
-    ESP_RETURN_ON_ERROR(ky040_install_isr_service_once(0), KY040_TAG, "ISR service");
+    bool batched = (s_batched_isr != NULL);
+    if (gpio_isr && !batched) {
+        ESP_RETURN_ON_ERROR(ky040_install_isr_service_once(0), KY040_TAG, "ISR service");
+    }
+    if (s_encoder_count >= KY040_MAX_ENCODERS) return ESP_ERR_NO_MEM;
 
     struct ky040_encoder* e = (struct ky040_encoder*)calloc(1, sizeof(*e));
     if (!e) return ESP_ERR_NO_MEM;
 
     e->clk = cfg->gpio_clk;
     e->dt  = cfg->gpio_dt;
-    e->sw  = cfg->gpio_sw;
+    e->sw  = gpio_isr ? cfg->gpio_sw : -1;
+    e->gpio_isr = gpio_isr;
+    e->pin_mask = BIT(e->clk) | BIT(e->dt) | (e->sw >= 0 ? BIT(e->sw) : 0);
     e->ticks = 0;
     e->last_edge_us = esp_timer_get_time();
+    e->min_gap_us = UINT32_MAX;
     e->debounce_us = cfg->debounce_us;
+    if (cfg->debounce_max_us) {
+        if (cfg->debounce_min_us > cfg->debounce_max_us) {
+            free(e);
+            return ESP_ERR_INVALID_ARG;
+        }
+        e->debounce_min_us = cfg->debounce_min_us;
+        e->debounce_max_us = cfg->debounce_max_us;
+        // Start narrow: a wide first window would drop edges of a shaft
+        // already turning fast, the average opens it within a few edges.
+        e->debounce_us     = cfg->debounce_min_us;
+        e->edge_gap_avg_us = 4 * cfg->debounce_min_us;
+    }
     e->reverse = cfg->reverse_dir;
+    e->decode  = gpio_isr ? cfg->decode : KY040_DECODE_X4;
+    e->filter  = cfg->filter;
     e->ang_min = cfg->angle_min;
     e->ang_max = cfg->angle_max;
     e->span    = (uint16_t)span;
+    e->multi_turn = cfg->multi_turn;
+    if (cfg->multi_turn) {
+        // Only divide here: output degrees per tick = 360 * den / (cpr * num)
+        uint32_t num = cfg->gear_num ? cfg->gear_num : 1;
+        uint32_t den = cfg->gear_den ? cfg->gear_den : 1;
+        e->deg_q32 = ((uint64_t)(360u * den) << 32) / ((uint64_t)cfg->counts_per_rev * num);
+    }
     e->mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    e->on_change   = cfg->on_change;
+    e->user_ctx    = cfg->user_ctx;
+    e->notify_task = cfg->notify_task;
+    e->armed       = true;
+    e->sw_mode     = cfg->sw_mode;
 
+    if (e->filter == KY040_FILTER_HW) {
+        esp_err_t err = _glitch_filter_add(e->clk, &e->glitch[0]);
+        if (err == ESP_OK) err = _glitch_filter_add(e->dt, &e->glitch[1]);
+        if (err != ESP_OK) {
+            _glitch_filter_del(e->glitch[0]);
+            _glitch_filter_del(e->glitch[1]);
+            free(e);
+            return err;
+        }
+        e->debounce_us = 0;
+        e->debounce_max_us = 0;
+    }
+
+    bool x4 = (e->decode == KY040_DECODE_X4);
     gpio_config_t io = {
         .pin_bit_mask = (1ULL << e->clk) | (1ULL << e->dt),
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_POSEDGE
+        .intr_type = !gpio_isr ? GPIO_INTR_DISABLE : x4 ? GPIO_INTR_ANYEDGE : GPIO_INTR_POSEDGE
     };
     ESP_ERROR_CHECK(gpio_config(&io));
-    ESP_ERROR_CHECK(gpio_set_intr_type(e->dt, GPIO_INTR_DISABLE));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(e->clk, ky040_isr_clk, (void*)e));
+    if (x4) e->quad_state = _quad_read(e);
+    if (!gpio_isr) {
+        // Backend feeds ky040_priv_feed(), no GPIO interrupt
+    } else if (batched) {
+        if (!x4) ESP_ERROR_CHECK(gpio_set_intr_type(e->dt, GPIO_INTR_DISABLE));
+    } else if (x4) {
+        ESP_ERROR_CHECK(gpio_isr_handler_add(e->clk, ky040_isr_quad, (void*)e));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(e->dt,  ky040_isr_quad, (void*)e));
+    } else {
+        ESP_ERROR_CHECK(gpio_set_intr_type(e->dt, GPIO_INTR_DISABLE));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(e->clk, ky040_isr_clk, (void*)e));
+    }
 
     if (e->sw >= 0) {
         gpio_config_t io_sw = {
@@ -112,20 +461,61 @@ esp_err_t ky040_create(const ky040_config_t* cfg, ky040_handle_t* out) {
             .intr_type = GPIO_INTR_NEGEDGE
         };
         ESP_ERROR_CHECK(gpio_config(&io_sw));
-        ESP_ERROR_CHECK(gpio_isr_handler_add(e->sw, ky040_isr_sw, (void*)e));
+        if (!batched) ESP_ERROR_CHECK(gpio_isr_handler_add(e->sw, ky040_isr_sw, (void*)e));
     }
 
+    portENTER_CRITICAL(&s_reg_mux);
+    s_encoders[s_encoder_count++] = e;
+    portEXIT_CRITICAL(&s_reg_mux);
+
     *out = e;
     return ESP_OK;
 }
 
 void ky040_delete(ky040_handle_t h) {
     if (!h) return;
-    gpio_isr_handler_remove(h->clk);
-    if (h->sw >= 0) gpio_isr_handler_remove(h->sw);
+    portENTER_CRITICAL(&s_reg_mux);
+    for (int i = 0; i < s_encoder_count; i++) {
+        if (s_encoders[i] != h) continue;
+        s_encoders[i] = s_encoders[--s_encoder_count];
+        break;
+    }
+    portEXIT_CRITICAL(&s_reg_mux);
+
+    if (h->backend_del) h->backend_del(h->backend);
+    if (!h->gpio_isr) {
+        // nothing registered with the GPIO driver
+    } else if (s_batched_isr) {
+        gpio_set_intr_type(h->clk, GPIO_INTR_DISABLE);
+        gpio_set_intr_type(h->dt, GPIO_INTR_DISABLE);
+        if (h->sw >= 0) gpio_set_intr_type(h->sw, GPIO_INTR_DISABLE);
+    } else {
+        gpio_isr_handler_remove(h->clk);
+        if (h->decode == KY040_DECODE_X4) gpio_isr_handler_remove(h->dt);
+        if (h->sw >= 0) gpio_isr_handler_remove(h->sw);
+    }
+    _glitch_filter_del(h->glitch[0]);
+    _glitch_filter_del(h->glitch[1]);
     free(h);
 }
 
+void ky040_priv_set_backend(ky040_handle_t h, void* backend, void (*del)(void* backend)) {
+    h->backend = backend;
+    h->backend_del = del;
+}
+
+void* ky040_priv_get_backend(ky040_handle_t h) {
+    return h->backend;
+}
+
+void ky040_priv_feed(ky040_handle_t h, uint8_t state, int64_t t_us) {
+    if (_quad_edge_at(h, state & 3, t_us)) _notify(h);
+}
+
+void ky040_priv_feed_done(ky040_handle_t h, int64_t t_us) {
+    h->fed_us = (uint32_t)t_us;
+}
+
 void ky040_set_reverse(ky040_handle_t h, bool reverse) {
     if (!h) return;
     h->reverse = reverse;
@@ -134,10 +524,57 @@ void ky040_set_reverse(ky040_handle_t h, bool reverse) {
 void ky040_reset_zero(ky040_handle_t h) {
     if (!h) return;
     portENTER_CRITICAL(&h->mux);
+    _seq_write_begin(h);
     h->ticks = 0;
+    _seq_write_end(h);
     portEXIT_CRITICAL(&h->mux);
 }
 
+void ky040_shift_position(ky040_handle_t h, int64_t delta) {
+    if (!h) return;
+    portENTER_CRITICAL(&h->mux);
+    _seq_write_begin(h);
+    h->ticks += delta;
+    if (!h->multi_turn) h->ticks = (h->ticks % h->span + h->span) % h->span;
+    _seq_write_end(h);
+    portEXIT_CRITICAL(&h->mux);
+}
+
+esp_err_t ky040_arm_index(ky040_handle_t h) {
+    if (!h) return ESP_ERR_INVALID_ARG;
+    if (h->sw < 0) return ESP_ERR_NOT_SUPPORTED;
+    portENTER_CRITICAL(&h->mux);
+    h->index_valid = false;
+    h->index_armed = true;
+    portEXIT_CRITICAL(&h->mux);
+    return ESP_OK;
+}
+
+esp_err_t ky040_get_index(ky040_handle_t h, int64_t* ticks, int64_t* t_us) {
+    if (!h || !ticks) return ESP_ERR_INVALID_ARG;
+    esp_err_t ret = ESP_ERR_NOT_FINISHED;
+    portENTER_CRITICAL(&h->mux);
+    if (h->index_valid) {
+        *ticks = h->index_ticks;
+        if (t_us) *t_us = h->index_us;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&h->mux);
+    return ret;
+}
+
+int ky040_get_sw_level(ky040_handle_t h) {
+    if (!h || h->sw < 0) return -1;
+    return gpio_get_level(h->sw);
+}
+
+esp_err_t ky040_set_notify_task(ky040_handle_t h, TaskHandle_t task) {
+    if (!h) return ESP_ERR_INVALID_ARG;
+    h->notify_task = task;
+    h->armed = true;
+    return ESP_OK;
+}
+
 esp_err_t ky040_set_range(ky040_handle_t h, uint16_t angle_min, uint16_t angle_max) {
     if (!h) return ESP_ERR_INVALID_ARG;
     if (angle_max < angle_min) return ESP_ERR_INVALID_ARG;
@@ -145,26 +582,162 @@ esp_err_t ky040_set_range(ky040_handle_t h, uint16_t angle_min, uint16_t angle_m
     if (span == 0 || span > 65535) return ESP_ERR_INVALID_ARG;
 
     portENTER_CRITICAL(&h->mux);
+    _seq_write_begin(h);
     h->ang_min = angle_min;
     h->ang_max = angle_max;
     h->span    = (uint16_t)span;
-    if (h->ticks >= (int32_t)h->span) h->ticks %= h->span;
-    if (h->ticks < 0)                 h->ticks = (h->ticks % h->span + h->span) % h->span;
+    if (!h->multi_turn) {
+        if (h->ticks >= h->span) h->ticks %= h->span;
+        if (h->ticks < 0)        h->ticks = (h->ticks % h->span + h->span) % h->span;
+    }
+    _seq_write_end(h);
     portEXIT_CRITICAL(&h->mux);
     return ESP_OK;
 }
 
+esp_err_t ky040_snapshot(ky040_handle_t h, ky040_snapshot_t* out) {
+    if (!h || !out) return ESP_ERR_INVALID_ARG;
+    h->armed = true;   // a change after this read notifies again
+    uint32_t s0, s1;
+    do {
+        s0 = h->seq;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        out->ticks        = h->ticks;
+        out->last_edge_us = h->last_edge_us;
+        out->edges        = h->edges;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        s1 = h->seq;
+    } while ((s0 & 1) || s0 != s1);
+    return ESP_OK;
+}
+
+// Encoder ISRs are masked for the copy, so every encoder is captured at the
+// same instant and no per-encoder retry is needed.
+void IRAM_ATTR ky040_latch_all(void) {
+    portENTER_CRITICAL_SAFE(&s_reg_mux);
+    s_latch_seq++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (int i = 0; i < s_encoder_count; i++) {
+        struct ky040_encoder* e = s_encoders[i];
+        e->latch.ticks        = e->ticks;
+        e->latch.last_edge_us = e->last_edge_us;
+        e->latch.edges        = e->edges;
+    }
+    s_latch_us = esp_timer_get_time();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    s_latch_seq++;
+    portEXIT_CRITICAL_SAFE(&s_reg_mux);
+}
+
+esp_err_t ky040_get_latched(ky040_handle_t h, ky040_snapshot_t* out, int64_t* latch_us) {
+    if (!h || !out) return ESP_ERR_INVALID_ARG;
+    uint32_t s0, s1;
+    int64_t t;
+    do {
+        s0 = s_latch_seq;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        *out = h->latch;
+        t = s_latch_us;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        s1 = s_latch_seq;
+    } while ((s0 & 1) || s0 != s1);
+    if (latch_us) *latch_us = t;
+    return ESP_OK;
+}
+
 int32_t ky040_get_ticks(ky040_handle_t h) {
+    return (int32_t)ky040_get_position(h);
+}
+
+int64_t ky040_get_position(ky040_handle_t h) {
+    ky040_snapshot_t snap;
+    if (ky040_snapshot(h, &snap) != ESP_OK) return 0;
+    return snap.ticks;
+}
+
+int64_t ky040_get_angle_q16(ky040_handle_t h) {
     if (!h) return 0;
-    int32_t t;
-    portENTER_CRITICAL(&h->mux);
-    t = h->ticks;
-    portEXIT_CRITICAL(&h->mux);
-    return t;
+    int64_t t = ky040_get_position(h);
+    if (!h->multi_turn) return (int64_t)_angle_mod(h, t) << 16;
+    return _mul_q32_shr16(t, h->deg_q32);
 }
 
 uint16_t ky040_get_angle(ky040_handle_t h) {
     if (!h) return 0;
-    int32_t t = ky040_get_ticks(h);
-    return _angle_mod(h, t);
+    return _angle_mod(h, ky040_get_position(h));
+}
+
+esp_err_t ky040_get_velocity(ky040_handle_t h, int32_t* mticks_per_s) {
+    if (!h || !mticks_per_s) return ESP_ERR_INVALID_ARG;
+    uint32_t t[KY040_EDGE_RING];
+    int8_t   d[KY040_EDGE_RING];
+    uint32_t edges, s0, s1, now;
+    do {
+        s0 = h->seq;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        // A backend delivers edges late: age them against the end of what
+        // it has fed, not against the current time.
+        now = h->gpio_isr ? (uint32_t)esp_timer_get_time() : h->fed_us;
+        edges = h->edges;
+        for (int i = 0; i < KY040_EDGE_RING; i++) {
+            t[i] = h->edge_us[i];
+            d[i] = h->edge_dir[i];
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        s1 = h->seq;
+    } while ((s0 & 1) || s0 != s1);
+
+    *mticks_per_s = 0;
+    uint32_t n = edges < KY040_EDGE_RING ? edges : KY040_EDGE_RING;
+    if (n < 2) return ESP_OK;
+
+    uint32_t newest = (edges - 1) & (KY040_EDGE_RING - 1);
+    uint32_t prev   = (edges - 2) & (KY040_EDGE_RING - 1);
+    uint32_t age    = now - t[newest];
+    if ((int32_t)age < 0) age = 0;   // fed past fed_us by a process call in flight
+    if (age > KY040_VEL_TIMEOUT_US) return ESP_OK;
+
+    uint32_t period = t[newest] - t[prev];
+    if (period >= KY040_VEL_SWITCH_US || age >= KY040_VEL_SWITCH_US) {
+        // Slow (or just stopped): 1/T of the last edge, decaying with its age
+        if (age > period) period = age;
+        *mticks_per_s = (int32_t)((int64_t)d[newest] * 1000000000LL / period);
+        return ESP_OK;
+    }
+
+    // Fast: net edges over the span of the whole ring
+    uint32_t oldest = (edges - n) & (KY040_EDGE_RING - 1);
+    uint32_t span = t[newest] - t[oldest];
+    int32_t net = 0;
+    for (uint32_t i = 1; i < n; i++) net += d[(oldest + i) & (KY040_EDGE_RING - 1)];
+    if (span == 0) return ESP_OK;
+    *mticks_per_s = (int32_t)((int64_t)net * 1000000000LL / span);
+    return ESP_OK;
+}
+
+esp_err_t ky040_get_stats(ky040_handle_t h, ky040_stats_t* out) {
+    if (!h || !out) return ESP_ERR_INVALID_ARG;
+    uint32_t calls = h->isr_calls;
+    uint32_t gap = h->min_gap_us;
+    out->edges            = h->edges;
+    out->debounce_rejects = h->rejects;
+    out->debounce_us      = h->debounce_us;
+    out->illegal          = h->illegal;
+    out->peak_edge_hz     = (gap == UINT32_MAX) ? 0 : 1000000u / (gap ? gap : 1);
+    out->isr_calls        = calls;
+    out->isr_cycles_max   = h->isr_cyc_max;
+    out->isr_cycles_avg   = calls ? (uint32_t)(h->isr_cyc_sum / calls) : 0;
+    return ESP_OK;
+}
+
+void ky040_reset_stats(ky040_handle_t h) {
+    if (!h) return;
+    portENTER_CRITICAL(&h->mux);
+    h->rejects     = 0;
+    h->illegal     = 0;
+    h->min_gap_us  = UINT32_MAX;
+    h->isr_calls   = 0;
+    h->isr_cyc_max = 0;
+    h->isr_cyc_sum = 0;
+    portEXIT_CRITICAL(&h->mux);
 }
\ No newline at end of file
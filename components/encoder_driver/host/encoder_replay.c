@@ -0,0 +1,384 @@
+// Host-side waveform replay harness for encoder_driver.c
+//
+// Builds the real driver against the mocks in ./mock and feeds it synthetic
+// or recorded quadrature waveforms, then compares the decoded count with the
+// expected one and measures host decode throughput.
+//
+// Build (from components/encoder_driver):
+//   cc -O2 -Wall -Ihost/mock -Iinclude -Ipriv_include encoder_driver.c ky040_rmt.c host/mock/mock_esp.c host/mock/mock_rmt.c host/encoder_replay.c -o /tmp/encoder_replay
+//
+// Run:
+//   /tmp/encoder_replay                   default suite, non-zero exit on regression
+//   /tmp/encoder_replay --x4 --rate 20000 --bounce 3 --bounce-us 5 --latency 2
+//   /tmp/encoder_replay --rmt --rate 4000 --velocity
+//   /tmp/encoder_replay --x1 --debounce 1500 --sweep
+//   /tmp/encoder_replay --x4 --csv capture.csv   lines of "t_us,clk,dt"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "encoder_driver.h"
+#include "mock_esp.h"
+
+#define PIN_CLK 7
+#define PIN_DT  4
+
+typedef struct {
+    int64_t t_us;
+    int pin;
+    int level;
+} edge_event_t;
+
+typedef struct {
+    edge_event_t* ev;
+    size_t n, cap;
+    int64_t expect_x1;      // CLK rising edges, signed
+    int64_t expect_x4;      // quarter steps, signed
+    bool expect_known;
+} waveform_t;
+
+typedef struct {
+    const char* name;
+    ky040_decode_t decode;
+    bool batched;
+    uint32_t debounce_us;
+    uint32_t rate_hz;       // quadrature edges per second (both lines)
+    uint32_t steps;         // quarter steps forward, then half of them back
+    uint32_t bounce;        // extra toggle pairs after each edge
+    uint32_t bounce_us;     // spacing of the bounce toggles
+    uint32_t jitter_us;     // +/- uniform jitter on every edge
+    uint32_t latency_us;    // interrupt entry latency, merges closer edges
+    unsigned seed;
+    const char* csv;
+    bool must_match;        // suite: count mismatch is a regression, else the row is informational
+    uint32_t debounce_min_us;   // adaptive window bounds, max 0 = fixed
+    uint32_t debounce_max_us;
+    bool rmt;               // decode through the RMT backend (always X4)
+    bool velocity;          // check ky040_get_velocity halfway through the forward run
+    // Bounce only the CLK rising edge. X1 interrupts on that edge alone, so
+    // bounce after a CLK fall arrives as a rise long after the last accepted
+    // edge and no debounce window can reject it (use X4 or the HW filter).
+    bool rise_bounce;
+} scenario_t;
+
+#define RMT_PROCESS_US 1000     // ky040_rmt_process period, the control rate
+#define VEL_TOL_PCT    5
+
+static void _push(waveform_t* w, int64_t t, int pin, int level) {
+    if (w->n == w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 1024;
+        w->ev = realloc(w->ev, w->cap * sizeof(*w->ev));
+        if (!w->ev) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    w->ev[w->n++] = (edge_event_t){ t, pin, level };
+}
+
+static int _cmp_event(const void* a, const void* b) {
+    const edge_event_t* x = a;
+    const edge_event_t* y = b;
+    return (x->t_us > y->t_us) - (x->t_us < y->t_us);
+}
+
+// Rest state 11; forward (CLK leads) is 11 -> 01 -> 00 -> 10 -> 11
+static void _synthesize(const scenario_t* sc, waveform_t* w) {
+    srand(sc->seed);
+    int clk = 1, dt = 1;
+    uint32_t total = sc->steps + sc->steps / 2;
+    double period = 1e6 / sc->rate_hz;
+    int64_t last_t = 0;
+
+    for (uint32_t i = 0; i < total; i++) {
+        bool fwd = i < sc->steps;
+        int64_t t = (int64_t)((i + 1) * period);
+        if (sc->jitter_us) t += (rand() % (2 * (int)sc->jitter_us + 1)) - (int)sc->jitter_us;
+        if (t <= last_t) t = last_t + 1;
+        last_t = t;
+
+        // Forward toggles CLK when CLK == DT, reverse toggles DT when CLK == DT
+        bool move_clk = fwd ? (clk == dt) : (clk != dt);
+        int pin = move_clk ? PIN_CLK : PIN_DT;
+        int* line = move_clk ? &clk : &dt;
+        *line ^= 1;
+        _push(w, t, pin, *line);
+
+        uint32_t bounce = (sc->rise_bounce && !(move_clk && clk == 1)) ? 0 : sc->bounce;
+        for (uint32_t b = 0; b < bounce; b++) {
+            _push(w, t + (2 * b + 1) * sc->bounce_us, pin, !*line);
+            _push(w, t + (2 * b + 2) * sc->bounce_us, pin, *line);
+        }
+
+        w->expect_x4 += fwd ? +1 : -1;
+        if (move_clk && clk == 1) w->expect_x1 += (dt == 0) ? +1 : -1;
+    }
+    w->expect_known = true;
+    qsort(w->ev, w->n, sizeof(*w->ev), _cmp_event);
+}
+
+static int _load_csv(const char* path, waveform_t* w) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[128];
+    int clk = 1, dt = 1;
+    while (fgets(line, sizeof(line), f)) {
+        long long t;
+        int c, d;
+        if (sscanf(line, "%lld,%d,%d", &t, &c, &d) != 3) continue;
+        if (c != clk) _push(w, t, PIN_CLK, clk = c);
+        if (d != dt)  _push(w, t, PIN_DT, dt = d);
+    }
+    fclose(f);
+    w->expect_known = false;
+    return 0;
+}
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Runs in a forked child so every scenario starts with fresh driver statics
+static int _run(const scenario_t* sc, bool quiet) {
+    waveform_t w = { 0 };
+    if (sc->csv) {
+        if (_load_csv(sc->csv, &w) != 0) return 2;
+    } else {
+        _synthesize(sc, &w);
+    }
+
+    mock_gpio_reset();
+    mock_time_us = 0;
+    if (sc->batched) ky040_install_batched_isr(0);
+
+    ky040_config_t cfg = {
+        .gpio_clk = PIN_CLK,
+        .gpio_dt = PIN_DT,
+        .gpio_sw = -1,
+        .debounce_us = sc->debounce_us,
+        .debounce_min_us = sc->debounce_min_us,
+        .debounce_max_us = sc->debounce_max_us,
+        .angle_min = 0,
+        .angle_max = 90,
+        .decode = sc->decode,
+        .multi_turn = true,
+        .counts_per_rev = sc->decode == KY040_DECODE_X4 ? 80 : 20,
+    };
+    ky040_handle_t h = NULL;
+    ky040_rmt_config_t rc = { 0 };
+    esp_err_t err = sc->rmt ? ky040_create_rmt(&cfg, &rc, &h) : ky040_create(&cfg, &h);
+    if (err != ESP_OK) {
+        fprintf(stderr, "ky040_create failed\n");
+        return 2;
+    }
+    // ky040_create_rmt defaults, the edges it decodes trail real time by lag
+    uint32_t lag_us = sc->rmt ? 2 * 48 * 200 : 0;
+
+    // Forward run at a constant rate: sample the velocity in its middle
+    int64_t vel_at = sc->velocity ? (int64_t)(sc->steps / 2 * 1e6 / sc->rate_hz) + lag_us : -1;
+    int32_t vel = 0;
+    int32_t vel_expect = (int32_t)((sc->decode == KY040_DECODE_X4 || sc->rmt) ? sc->rate_hz * 1000u : sc->rate_hz * 250u);
+
+    uint64_t busy_ns = 0;
+    int64_t service_at = -1;
+    int64_t process_at = RMT_PROCESS_US;
+    for (size_t i = 0; i <= w.n; i++) {
+        int64_t t = (i < w.n) ? w.ev[i].t_us : INT64_MAX;
+        if (sc->rmt) {
+            // Drain every frame up to the end of the waveform, then process
+            if (i == w.n) t = w.ev[w.n - 1].t_us + lag_us + 2 * RMT_PROCESS_US;
+            while (process_at <= t) {
+                mock_rmt_advance(process_at);
+                mock_time_us = process_at;
+                uint64_t t0 = _now_ns();
+                ky040_rmt_process(h);
+                busy_ns += _now_ns() - t0;
+                if (vel_at >= 0 && process_at >= vel_at) {
+                    ky040_get_velocity(h, &vel);
+                    vel_at = -1;
+                }
+                process_at += RMT_PROCESS_US;
+            }
+            if (i == w.n) break;
+            mock_time_us = t;
+            mock_gpio_drive(w.ev[i].pin, w.ev[i].level);
+            mock_rmt_drive(w.ev[i].pin, w.ev[i].level, t);
+            continue;
+        }
+        if (vel_at >= 0 && t >= vel_at) {
+            mock_time_us = vel_at;
+            ky040_get_velocity(h, &vel);
+            vel_at = -1;
+        }
+        if (service_at >= 0 && service_at <= t) {
+            mock_time_us = service_at;
+            uint64_t t0 = _now_ns();
+            mock_gpio_service();
+            busy_ns += _now_ns() - t0;
+            service_at = -1;
+        }
+        if (i == w.n) break;
+        mock_time_us = t;
+        mock_gpio_drive(w.ev[i].pin, w.ev[i].level);
+        if (service_at < 0 && mock_gpio_pending()) {
+            service_at = t + sc->latency_us;
+            if (sc->latency_us == 0) {
+                uint64_t t0 = _now_ns();
+                mock_gpio_service();
+                busy_ns += _now_ns() - t0;
+                service_at = -1;
+            }
+        }
+    }
+
+    int64_t got = ky040_get_position(h);
+    int64_t expect = (sc->decode == KY040_DECODE_X4 || sc->rmt) ? w.expect_x4 : w.expect_x1;
+    ky040_stats_t st;
+    ky040_get_stats(h, &st);
+    bool ok = !w.expect_known || got == expect;
+    if (sc->velocity && llabs((int64_t)vel - vel_expect) * 100 > (int64_t)vel_expect * VEL_TOL_PCT) {
+        printf("%-28s velocity %d mticks/s, expected %d\n", sc->name, (int)vel, (int)vel_expect);
+        ok = false;
+    }
+
+    ky040_snapshot_t latched;
+    ky040_latch_all();
+    ky040_get_latched(h, &latched, NULL);
+    if (latched.ticks != got || latched.edges != st.edges) {
+        printf("%-28s latch mismatch: %lld vs %lld\n", sc->name, (long long)latched.ticks, (long long)got);
+        ok = false;
+    }
+
+    if (!quiet) {
+        printf("%-28s %s%s rate=%7u Hz  ", sc->name,
+               (sc->decode == KY040_DECODE_X4 || sc->rmt) ? "X4" : "X1", sc->rmt ? "r" : sc->batched ? "b" : " ", sc->rate_hz);
+        if (w.expect_known) {
+            double err = expect ? 100.0 * (double)(got - expect) / (double)llabs(expect) : 0.0;
+            printf("count %6lld / %6lld (%+6.1f%%)  ", (long long)got, (long long)expect, err);
+        } else {
+            printf("count %6lld  ", (long long)got);
+        }
+        printf("rej %5u ill %4u peak %7u Hz  %6.1f ns/isr  %s\n",
+               (unsigned)st.debounce_rejects, (unsigned)st.illegal, (unsigned)st.peak_edge_hz,
+               st.isr_calls ? (double)busy_ns / st.isr_calls : 0.0,
+               !w.expect_known ? "" : sc->must_match ? (ok ? "ok" : "FAIL") : (ok ? "info" : "lossy"));
+    }
+
+    ky040_delete(h);
+    free(w.ev);
+    return (ok || !sc->must_match) ? (ok ? 0 : 1) : 3;
+}
+
+static int _run_forked(const scenario_t* sc, bool quiet) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if (pid == 0) {
+        int rc = _run(sc, quiet);
+        fflush(stdout);
+        _exit(rc);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+}
+
+// Highest edge rate that still decodes to the exact count
+static void _sweep(scenario_t sc) {
+    uint32_t best = 0;
+    for (double r = 50; r <= 2e6; r *= 1.25) {
+        sc.rate_hz = (uint32_t)r;
+        sc.must_match = false;
+        if (_run_forked(&sc, true) != 0) break;
+        best = sc.rate_hz;
+    }
+    printf("%-28s %s%s max clean edge rate: %u Hz\n", sc.name,
+           sc.decode == KY040_DECODE_X4 ? "X4" : "X1", sc.batched ? "b" : " ", (unsigned)best);
+}
+
+static const scenario_t s_suite[] = {
+    { "x1 debounce, slow",      KY040_DECODE_X1, false, 1500,   200, 400, 0, 0,  0, 0, 1, NULL, true, 0, 0, false, false, false },
+    { "x1 debounce, fast",      KY040_DECODE_X1, false, 1500,  4000, 400, 0, 0,  0, 0, 1, NULL, false, 0, 0, false, false, false },
+    // Informational: without debounce the bounce pairs cancel, the count proves nothing
+    { "x1 no debounce, bounce", KY040_DECODE_X1, false,    0,   200, 400, 3, 20, 0, 0, 1, NULL, false, 0, 0, false, false, false },
+    { "x4 clean, fast",         KY040_DECODE_X4, false,    0, 50000, 4000, 0, 0, 0, 0, 1, NULL, true, 0, 0, false, false, false },
+    { "x4 bounce + latency",    KY040_DECODE_X4, false,    0,  1000, 4000, 3, 5, 0, 2, 1, NULL, true, 0, 0, false, false, false },
+    { "x4 jitter",              KY040_DECODE_X4, false,    0, 10000, 4000, 0, 0, 30, 1, 7, NULL, true, 0, 0, false, false, false },
+    { "x4 batched, bounce",     KY040_DECODE_X4, true,     0,  1000, 4000, 3, 5, 0, 2, 1, NULL, true, 0, 0, false, false, false },
+    { "x1 batched, slow",       KY040_DECODE_X1, true,  1500,   200, 400, 0, 0,  0, 0, 1, NULL, true, 0, 0, false, false, false },
+    { "x1 adaptive, slow",      KY040_DECODE_X1, false,    0,   200, 400, 0, 0, 300, 0, 3, NULL, true, 50, 3000, false, false, false },
+    { "x1 adaptive, fast",      KY040_DECODE_X1, false,    0,  4000, 4000, 0, 0, 20, 0, 3, NULL, true, 50, 3000, false, false, false },
+    { "x1 adaptive, bounce slow", KY040_DECODE_X1, false, 0,  200, 400, 3, 20, 0, 0, 5, NULL, true, 150, 3000, false, false, true },
+    { "x1 adaptive, bounce fast", KY040_DECODE_X1, false, 0, 4000, 4000, 3, 20, 0, 0, 5, NULL, true, 150, 3000, false, false, true },
+    { "x4 clean, velocity",     KY040_DECODE_X4, false,    0,  4000, 4000, 0, 0,  0, 0, 1, NULL, true, 0, 0, false, true, false },
+    { "rmt, slow",              KY040_DECODE_X4, false,    0,   200, 400, 0, 0,   0, 0, 1, NULL, true, 0, 0, true, false, false },
+    { "rmt, fast velocity",     KY040_DECODE_X4, false,    0,  4000, 4000, 0, 0,  0, 0, 1, NULL, true, 0, 0, true, true, false },
+};
+
+static void _usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--x1|--x4] [--batched|--rmt] [--velocity] [--debounce us] [--adaptive min max] [--rate hz] [--steps n]\n"
+            "          [--bounce n] [--bounce-us us] [--jitter us] [--latency us] [--seed n]\n"
+            "          [--csv file] [--sweep]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        int failed = 0;
+        for (size_t i = 0; i < sizeof(s_suite) / sizeof(s_suite[0]); i++) {
+            if (_run_forked(&s_suite[i], false) >= 2) failed++;
+        }
+        _sweep((scenario_t){ "sweep x1 debounce 1500", KY040_DECODE_X1, false, 1500, 0, 400, 0, 0, 0, 0, 1, NULL, false, 0, 0, false, false, false });
+        _sweep((scenario_t){ "sweep x4 latency 2us",   KY040_DECODE_X4, false, 0,    0, 4000, 0, 0, 0, 2, 1, NULL, false, 0, 0, false, false, false });
+        printf("%s\n", failed ? "REGRESSION" : "all exact scenarios ok");
+        return failed ? 1 : 0;
+    }
+
+    scenario_t sc = { "cli", KY040_DECODE_X1, false, 0, 1000, 1000, 0, 0, 0, 0, 1, NULL, true, 0, 0, false, false, false };
+    bool sweep = false;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if      (!strcmp(a, "--x1"))      sc.decode = KY040_DECODE_X1;
+        else if (!strcmp(a, "--x4"))      sc.decode = KY040_DECODE_X4;
+        else if (!strcmp(a, "--batched")) sc.batched = true;
+        else if (!strcmp(a, "--rmt"))     sc.rmt = true;
+        else if (!strcmp(a, "--velocity")) sc.velocity = true;
+        else if (!strcmp(a, "--sweep"))   sweep = true;
+        else if (v && !strcmp(a, "--debounce"))  { sc.debounce_us = atoi(v); i++; }
+        else if (v && i + 2 < argc && !strcmp(a, "--adaptive")) {
+            sc.debounce_min_us = atoi(v);
+            sc.debounce_max_us = atoi(argv[i + 2]);
+            i += 2;
+        }
+        else if (v && !strcmp(a, "--rate"))      { sc.rate_hz = atoi(v); i++; }
+        else if (v && !strcmp(a, "--steps"))     { sc.steps = atoi(v); i++; }
+        else if (v && !strcmp(a, "--bounce"))    { sc.bounce = atoi(v); i++; }
+        else if (v && !strcmp(a, "--bounce-us")) { sc.bounce_us = atoi(v); i++; }
+        else if (v && !strcmp(a, "--jitter"))    { sc.jitter_us = atoi(v); i++; }
+        else if (v && !strcmp(a, "--latency"))   { sc.latency_us = atoi(v); i++; }
+        else if (v && !strcmp(a, "--seed"))      { sc.seed = atoi(v); i++; }
+        else if (v && !strcmp(a, "--csv"))       { sc.csv = v; i++; }
+        else {
+            _usage(argv[0]);
+            return 2;
+        }
+    }
+    if (sc.rate_hz == 0) sc.rate_hz = 1;
+    if (sweep) {
+        _sweep(sc);
+        return 0;
+    }
+    return _run_forked(&sc, false) >= 2;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef struct rmt_channel_t* rmt_channel_handle_t;
+
+typedef union {
+    struct {
+        uint32_t duration0 : 15;
+        uint32_t level0 : 1;
+        uint32_t duration1 : 15;
+        uint32_t level1 : 1;
+    };
+    uint32_t val;
+} rmt_symbol_word_t;
+
+typedef struct {
+    rmt_symbol_word_t* received_symbols;
+    size_t num_symbols;
+    struct {
+        uint32_t is_last : 1;
+    } flags;
+} rmt_rx_done_event_data_t;
+
+typedef bool (*rmt_rx_done_callback_t)(rmt_channel_handle_t chan, const rmt_rx_done_event_data_t* edata, void* user_ctx);
+
+typedef struct {
+    rmt_rx_done_callback_t on_recv_done;
+} rmt_rx_event_callbacks_t;
+
+typedef int rmt_clock_source_t;
+#define RMT_CLK_SRC_DEFAULT 0
+
+typedef struct {
+    gpio_num_t gpio_num;
+    rmt_clock_source_t clk_src;
+    uint32_t resolution_hz;
+    size_t mem_block_symbols;
+} rmt_rx_channel_config_t;
+
+typedef struct {
+    uint32_t signal_range_min_ns;
+    uint32_t signal_range_max_ns;
+    struct {
+        uint32_t en_partial_rx : 1;
+    } flags;
+} rmt_receive_config_t;
+
+esp_err_t rmt_new_rx_channel(const rmt_rx_channel_config_t* config, rmt_channel_handle_t* ret_chan);
+esp_err_t rmt_rx_register_event_callbacks(rmt_channel_handle_t chan, const rmt_rx_event_callbacks_t* cbs, void* user_data);
+esp_err_t rmt_enable(rmt_channel_handle_t chan);
+esp_err_t rmt_disable(rmt_channel_handle_t chan);
+esp_err_t rmt_del_channel(rmt_channel_handle_t chan);
+esp_err_t rmt_receive(rmt_channel_handle_t chan, void* buffer, size_t buffer_size, const rmt_receive_config_t* config);
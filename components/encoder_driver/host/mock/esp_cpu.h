@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+// Host nanoseconds stand in for CPU cycles
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
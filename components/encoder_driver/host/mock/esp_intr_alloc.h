@@ -0,0 +1,8 @@
+#pragma once
+#include "esp_err.h"
+
+typedef struct intr_handle_data_t* intr_handle_t;
+
+#define ESP_INTR_FLAG_IRAM      (1 << 10)
+
+esp_err_t esp_intr_free(intr_handle_t handle);
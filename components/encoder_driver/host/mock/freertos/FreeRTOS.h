@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/portmacro.h"
+
+typedef uint32_t TickType_t;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
@@ -0,0 +1,25 @@
+// Single-threaded host: critical sections are no-ops, the harness calls the
+// ISRs synchronously.
+#pragma once
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+typedef struct { volatile uint32_t owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+#define portENTER_CRITICAL_SAFE(mux)    ((void)(mux))
+#define portEXIT_CRITICAL_SAFE(mux)     ((void)(mux))
+#define portYIELD_FROM_ISR(...)         ((void)0)
+#define portYIELD()                     ((void)0)
+
+// True while mock_gpio_service() runs a handler
+BaseType_t xPortInIsrContext(void);
+
+#define IRAM_ATTR
+#define DRAM_ATTR
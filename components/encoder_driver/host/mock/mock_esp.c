@@ -0,0 +1,197 @@
+// Host implementation of the ESP-IDF calls used by encoder_driver.c
+#include <stdlib.h>
+#include <time.h>
+
+#include "mock_esp.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "driver/gpio.h"
+#include "driver/gpio_filter.h"
+#include "freertos/task.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+int64_t mock_time_us = 0;
+
+static int             s_level[MOCK_GPIO_COUNT];
+static gpio_int_type_t s_intr[MOCK_GPIO_COUNT];
+static gpio_isr_t      s_handler[MOCK_GPIO_COUNT];
+static void*           s_handler_arg[MOCK_GPIO_COUNT];
+static uint32_t        s_status;
+static bool            s_service;
+static void          (*s_global_fn)(void*);
+static void*           s_global_arg;
+static BaseType_t      s_in_isr;
+
+static bool _valid(gpio_num_t pin) {
+    return pin >= 0 && pin < MOCK_GPIO_COUNT;
+}
+
+void mock_gpio_reset(void) {
+    for (int i = 0; i < MOCK_GPIO_COUNT; i++) {
+        s_level[i] = 1;                  // pull-ups
+        s_intr[i] = GPIO_INTR_DISABLE;
+        s_handler[i] = NULL;
+        s_handler_arg[i] = NULL;
+    }
+    s_status = 0;
+    s_service = false;
+    s_global_fn = NULL;
+    s_global_arg = NULL;
+}
+
+void mock_gpio_drive(gpio_num_t pin, int level) {
+    if (!_valid(pin)) return;
+    level = level ? 1 : 0;
+    if (s_level[pin] == level) return;
+    s_level[pin] = level;
+
+    bool hit = false;
+    switch (s_intr[pin]) {
+    case GPIO_INTR_POSEDGE: hit = (level == 1); break;
+    case GPIO_INTR_NEGEDGE: hit = (level == 0); break;
+    case GPIO_INTR_ANYEDGE: hit = true; break;
+    default: break;
+    }
+    if (hit) s_status |= BIT(pin);
+}
+
+uint32_t mock_gpio_pending(void) {
+    return s_status;
+}
+
+void mock_gpio_service(void) {
+    if (!s_status) return;
+    s_in_isr = pdTRUE;
+    if (s_global_fn) {
+        s_global_fn(s_global_arg);       // clears s_status itself
+    } else {
+        uint32_t status = s_status;
+        s_status = 0;
+        for (int pin = 0; pin < MOCK_GPIO_COUNT; pin++) {
+            if ((status & BIT(pin)) && s_handler[pin]) s_handler[pin](s_handler_arg[pin]);
+        }
+    }
+    s_in_isr = pdFALSE;
+}
+
+BaseType_t xPortInIsrContext(void) {
+    return s_in_isr;
+}
+
+uint32_t mock_reg_read(uint32_t reg) {
+    switch (reg) {
+    case GPIO_IN_REG: {
+        uint32_t in = 0;
+        for (int i = 0; i < MOCK_GPIO_COUNT; i++) in |= (uint32_t)s_level[i] << i;
+        return in;
+    }
+    case GPIO_STATUS_REG:
+        return s_status;
+    default:
+        return 0;
+    }
+}
+
+void mock_reg_write(uint32_t reg, uint32_t val) {
+    if (reg == GPIO_STATUS_W1TC_REG) s_status &= ~val;
+}
+
+int64_t esp_timer_get_time(void) {
+    return mock_time_us;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (esp_cpu_cycle_count_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+esp_err_t gpio_config(const gpio_config_t* cfg) {
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < MOCK_GPIO_COUNT; i++) {
+        if (cfg->pin_bit_mask & (1ULL << i)) s_intr[i] = cfg->intr_type;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (!_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_intr[gpio_num] = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    if (s_service || s_global_fn) return ESP_ERR_INVALID_STATE;
+    s_service = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+    if (!_valid(gpio_num) || !s_service) return ESP_ERR_INVALID_STATE;
+    s_handler[gpio_num] = isr_handler;
+    s_handler_arg[gpio_num] = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+    if (!_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+    s_handler[gpio_num] = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_register(void (*fn)(void*), void* arg, int intr_alloc_flags, gpio_isr_handle_t* handle) {
+    (void)intr_alloc_flags;
+    if (s_service || s_global_fn) return ESP_ERR_INVALID_STATE;
+    s_global_fn = fn;
+    s_global_arg = arg;
+    if (handle) *handle = (gpio_isr_handle_t)(void*)&s_global_fn;
+    return ESP_OK;
+}
+
+esp_err_t esp_intr_free(intr_handle_t handle) {
+    (void)handle;
+    s_global_fn = NULL;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    return _valid(gpio_num) ? s_level[gpio_num] : 0;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    mock_gpio_drive(gpio_num, (int)level);
+    return ESP_OK;
+}
+
+esp_err_t gpio_new_pin_glitch_filter(const gpio_pin_glitch_filter_config_t* config, gpio_glitch_filter_handle_t* ret_filter) {
+    (void)config;
+    *ret_filter = (gpio_glitch_filter_handle_t)malloc(1);
+    return *ret_filter ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t gpio_del_glitch_filter(gpio_glitch_filter_handle_t filter) {
+    free(filter);
+    return ESP_OK;
+}
+
+esp_err_t gpio_glitch_filter_enable(gpio_glitch_filter_handle_t filter) {
+    (void)filter;
+    return ESP_OK;
+}
+
+esp_err_t gpio_glitch_filter_disable(gpio_glitch_filter_handle_t filter) {
+    (void)filter;
+    return ESP_OK;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    (void)task;
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_prio_woken) {
+    (void)task;
+    if (higher_prio_woken) *higher_prio_woken = pdFALSE;
+}
@@ -0,0 +1,23 @@
+// Harness side of the host mocks: simulated clock and GPIO pins.
+#pragma once
+#include <stdint.h>
+#include "driver/gpio.h"
+
+#define MOCK_GPIO_COUNT 32
+
+// Simulated esp_timer time, the harness moves it forward
+extern int64_t mock_time_us;
+
+void     mock_gpio_reset(void);
+// Drive an input pin from outside; latches its interrupt status when the
+// configured edge type matches, as the GPIO peripheral would.
+void     mock_gpio_drive(gpio_num_t pin, int level);
+uint32_t mock_gpio_pending(void);
+// Deliver the pending interrupt: per-pin handlers (ISR service) or the
+// single gpio_isr_register handler (batched mode).
+void     mock_gpio_service(void);
+
+// RMT RX channels (mock_rmt.c): time a pin's level change, and raise the
+// end-of-frame callbacks of lines that have been idle long enough by t_us.
+void     mock_rmt_drive(gpio_num_t pin, int level, int64_t t_us);
+void     mock_rmt_advance(int64_t t_us);
@@ -0,0 +1,129 @@
+// Host implementation of the RMT RX calls used by ky040_rmt.c
+//
+// Each channel times the level changes of its pin into (level, duration)
+// halves and hands them to the receive callback the way the driver does:
+// a partial frame when the buffer is full, the last one once the line has
+// held a level for signal_range_max_ns (that half has duration 0). The
+// callback runs at the simulated time the hardware would raise it.
+#include <stdlib.h>
+
+#include "mock_esp.h"
+#include "driver/rmt_rx.h"
+
+#define MOCK_RMT_CHANNELS 2
+#define MOCK_RMT_HALVES   512
+
+struct rmt_channel_t {
+    bool used;
+    gpio_num_t pin;
+    rmt_rx_done_callback_t cb;
+    void* ctx;
+    rmt_symbol_word_t* buf;
+    size_t buf_symbols;
+    uint32_t idle_us;
+    bool in_frame;
+    int level;
+    int64_t level_since;
+    size_t n;                     // halves collected for the next callback
+    uint8_t  lvl[MOCK_RMT_HALVES];
+    uint16_t dur[MOCK_RMT_HALVES];
+};
+
+static struct rmt_channel_t s_chan[MOCK_RMT_CHANNELS];
+
+static void _deliver(struct rmt_channel_t* c, int64_t at, bool last) {
+    size_t symbols = (c->n + 1) / 2;
+    for (size_t i = 0; i < symbols; i++) {
+        rmt_symbol_word_t* s = &c->buf[i];
+        s->val = 0;
+        s->level0 = c->lvl[2 * i];
+        s->duration0 = c->dur[2 * i];
+        if (2 * i + 1 < c->n) {
+            s->level1 = c->lvl[2 * i + 1];
+            s->duration1 = c->dur[2 * i + 1];
+        }
+    }
+    rmt_rx_done_event_data_t ev = {
+        .received_symbols = c->buf,
+        .num_symbols = symbols,
+        .flags.is_last = last,
+    };
+    c->n = 0;
+    mock_time_us = at;
+    c->cb(c, &ev, c->ctx);
+}
+
+static void _half(struct rmt_channel_t* c, int level, uint32_t dur) {
+    if (dur > 0x7fff) dur = 0x7fff;
+    c->lvl[c->n] = (uint8_t)level;
+    c->dur[c->n] = (uint16_t)dur;
+    c->n++;
+}
+
+void mock_rmt_advance(int64_t t_us) {
+    for (int i = 0; i < MOCK_RMT_CHANNELS; i++) {
+        struct rmt_channel_t* c = &s_chan[i];
+        if (!c->used || !c->in_frame) continue;
+        int64_t end = c->level_since + c->idle_us;
+        if (end > t_us) continue;
+        _half(c, c->level, 0);
+        c->in_frame = false;
+        _deliver(c, end, true);
+    }
+}
+
+void mock_rmt_drive(gpio_num_t pin, int level, int64_t t_us) {
+    mock_rmt_advance(t_us);
+    for (int i = 0; i < MOCK_RMT_CHANNELS; i++) {
+        struct rmt_channel_t* c = &s_chan[i];
+        if (!c->used || c->pin != pin || c->level == level) continue;
+        if (c->in_frame) _half(c, c->level, (uint32_t)(t_us - c->level_since));
+        c->in_frame = true;
+        c->level = level;
+        c->level_since = t_us;
+        if (c->n + 1 >= 2 * c->buf_symbols) _deliver(c, t_us, false);
+    }
+}
+
+esp_err_t rmt_new_rx_channel(const rmt_rx_channel_config_t* config, rmt_channel_handle_t* ret_chan) {
+    for (int i = 0; i < MOCK_RMT_CHANNELS; i++) {
+        struct rmt_channel_t* c = &s_chan[i];
+        if (c->used) continue;
+        *c = (struct rmt_channel_t){ 0 };
+        c->used = true;
+        c->pin = config->gpio_num;
+        c->level = gpio_get_level(config->gpio_num);
+        *ret_chan = c;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t rmt_rx_register_event_callbacks(rmt_channel_handle_t chan, const rmt_rx_event_callbacks_t* cbs, void* user_data) {
+    chan->cb = cbs->on_recv_done;
+    chan->ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t chan) {
+    (void)chan;
+    return ESP_OK;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t chan) {
+    (void)chan;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t chan) {
+    chan->used = false;
+    return ESP_OK;
+}
+
+esp_err_t rmt_receive(rmt_channel_handle_t chan, void* buffer, size_t buffer_size, const rmt_receive_config_t* config) {
+    chan->buf = (rmt_symbol_word_t*)buffer;
+    chan->buf_symbols = buffer_size / sizeof(rmt_symbol_word_t);
+    if (chan->buf_symbols * 2 > MOCK_RMT_HALVES) chan->buf_symbols = MOCK_RMT_HALVES / 2;
+    chan->idle_us = config->signal_range_max_ns / 1000u;
+    return ESP_OK;
+}
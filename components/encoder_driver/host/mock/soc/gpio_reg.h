@@ -0,0 +1,6 @@
+// ESP32-C3 GPIO register addresses used by the batched encoder ISR
+#pragma once
+
+#define GPIO_IN_REG             0x6000403C
+#define GPIO_STATUS_REG         0x60004044
+#define GPIO_STATUS_W1TC_REG    0x6000404C
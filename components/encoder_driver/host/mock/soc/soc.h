@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+
+#define BIT(nr)             (1UL << (nr))
+
+uint32_t mock_reg_read(uint32_t reg);
+void     mock_reg_write(uint32_t reg, uint32_t val);
+
+#define REG_READ(reg)       mock_reg_read(reg)
+#define REG_WRITE(reg, val) mock_reg_write((reg), (val))
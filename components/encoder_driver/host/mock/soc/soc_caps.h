@@ -0,0 +1,6 @@
+// ESP32-C3 subset
+#pragma once
+
+#define SOC_GPIO_PIN_COUNT                  22
+#define SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER  1
+#define SOC_GPIO_FLEX_GLITCH_FILTER_NUM     0
@@ -1,6 +1,8 @@
 #pragma once
 #include "esp_err.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,24 +12,124 @@ extern "C" {
 
 typedef struct ky040_encoder* ky040_handle_t;
 
+// Runs in the encoder ISR. Return true if it woke a higher-priority task.
+typedef bool (*ky040_change_cb_t)(ky040_handle_t h, void* user_ctx);
+
+typedef enum {
+    KY040_DECODE_X1 = 0,          // CLK rising edge only, DT sampled once
+    KY040_DECODE_X4,              // both edges of CLK and DT, table decoded
+} ky040_decode_t;
+
+typedef enum {
+    KY040_FILTER_SOFT = 0,        // esp_timer debounce in the ISR (debounce_us)
+    KY040_FILTER_HW,              // GPIO glitch filter on CLK/DT, no ISR debounce
+} ky040_filter_t;
+
+typedef enum {
+    KY040_SW_ZERO = 0,            // falling SW edge zeroes the count (push button)
+    KY040_SW_INDEX,               // SW is a home/limit input: edge only feeds ky040_arm_index
+} ky040_sw_mode_t;
+
 typedef struct {
     gpio_num_t gpio_clk;
     gpio_num_t gpio_dt;
     gpio_num_t gpio_sw;           // set to -1 if unused
     bool       reverse_dir;
-    uint32_t   debounce_us;       // 0 = off
+    uint32_t   debounce_us;       // 0 = off, ignored in X4 mode
     uint16_t   angle_min;         // e.g., 0
     uint16_t   angle_max;         // e.g., 90
+    ky040_decode_t decode;        // default KY040_DECODE_X1
+    ky040_filter_t filter;        // default KY040_FILTER_SOFT
+    bool       multi_turn;        // unwrapped 64-bit position, angle range only clamps
+    uint32_t   counts_per_rev;    // multi_turn: ticks per encoder shaft turn (after decode)
+    uint16_t   gear_num;          // multi_turn: encoder turns : output turns, 0 = 1
+    uint16_t   gear_den;
+    // Optional change signal: one per batch of edges, re-armed by the next
+    // ky040_snapshot/get_* read. notify_task gets a xTaskNotifyGive.
+    // on_change runs in the GPIO ISR: with ky040_install_batched_isr (an
+    // IRAM interrupt) it must be IRAM_ATTR and touch no flash data.
+    ky040_change_cb_t on_change;
+    void*      user_ctx;
+    TaskHandle_t notify_task;
+    // Speed-adaptive debounce (X1, soft filter): the window tracks a quarter
+    // of the average edge interval within these bounds, starting at min, which
+    // must outlast the contact bounce. max = 0: fixed debounce_us.
+    uint32_t   debounce_min_us;
+    uint32_t   debounce_max_us;
+    ky040_sw_mode_t sw_mode;      // default KY040_SW_ZERO
 } ky040_config_t;
 
+// One consistent view of the encoder state, see ky040_snapshot()
+typedef struct {
+    int64_t  ticks;
+    int64_t  last_edge_us;        // esp_timer time of the last accepted edge
+    uint32_t edges;               // accepted edges since create
+} ky040_snapshot_t;
+
+// ISR health counters, see ky040_get_stats()
+typedef struct {
+    uint32_t edges;               // accepted edges
+    uint32_t debounce_rejects;    // edges dropped by the debounce window
+    uint32_t debounce_us;         // current window (adaptive mode moves it)
+    uint32_t illegal;             // X4 transitions dropped as invalid
+    uint32_t peak_edge_hz;        // from the shortest interval between accepted edges
+    uint32_t isr_calls;
+    uint32_t isr_cycles_max;      // CPU cycles, handler body only (no IDF dispatch)
+    uint32_t isr_cycles_avg;
+} ky040_stats_t;
+
+// RMT capture backend, see ky040_create_rmt(). Zero fields take defaults.
+typedef struct {
+    uint32_t   filter_ns;         // RMT drops shorter pulses (C3: <= 3000), default 1000
+    uint32_t   idle_us;           // no edge for this long ends a capture frame, default 200
+    uint32_t   lag_us;            // decode only edges at least this old, default 96 * idle_us
+} ky040_rmt_config_t;
+
 esp_err_t ky040_install_isr_service_once(int intr_flags);
+// Alternative to the IDF ISR service: one IRAM GPIO interrupt decodes every
+// encoder from a single register read. Call before ky040_create. Owns the
+// GPIO interrupt, so it excludes gpio_isr_handler_add users.
+esp_err_t ky040_install_batched_isr(int intr_flags);
 esp_err_t ky040_create(const ky040_config_t* cfg, ky040_handle_t* out);
+// RMT backend: CLK and DT are captured by two RMT RX channels that time the
+// pulses in hardware, no GPIO interrupt per edge. ky040_rmt_process() decodes
+// the captured edges (X4) in a batch; call it at the control rate. lag_us
+// bounds how late the RMT can deliver an edge, so outputs trail real time by
+// that; velocity is measured on the same delayed time base.
+// The ESP32-C3 has two RX channels: one encoder. gpio_sw/debounce unused.
+esp_err_t ky040_create_rmt(const ky040_config_t* cfg, const ky040_rmt_config_t* rmt, ky040_handle_t* out);
+esp_err_t ky040_rmt_process(ky040_handle_t h);
 void      ky040_delete(ky040_handle_t h);
 void      ky040_set_reverse(ky040_handle_t h, bool reverse);
 void      ky040_reset_zero(ky040_handle_t h);
+// Add delta to the count (folded into the angle range unless multi_turn),
+// e.g. to move a latched index tick onto its home position.
+void      ky040_shift_position(ky040_handle_t h, int64_t delta);
+// Index latch on the SW input (falling edge): arm, then poll ky040_get_index
+// until it stops returning ESP_ERR_NOT_FINISHED. The tick is captured in the
+// ISR, so it does not depend on how late the caller polls.
+esp_err_t ky040_arm_index(ky040_handle_t h);
+esp_err_t ky040_get_index(ky040_handle_t h, int64_t* ticks, int64_t* t_us);
+int       ky040_get_sw_level(ky040_handle_t h);      // -1 if no SW pin
+esp_err_t ky040_set_notify_task(ky040_handle_t h, TaskHandle_t task);   // NULL = off
 esp_err_t ky040_set_range(ky040_handle_t h, uint16_t angle_min, uint16_t angle_max);
+// Lock-free read (sequence counter, no critical section). Task context only:
+// an ISR preempting the encoder ISR mid-update would spin forever.
+esp_err_t ky040_snapshot(ky040_handle_t h, ky040_snapshot_t* out);
+// Capture every registered encoder at one instant. ISR-safe (IRAM), e.g. from
+// the control timer ISR; read the result per encoder with ky040_get_latched.
+void      ky040_latch_all(void);
+esp_err_t ky040_get_latched(ky040_handle_t h, ky040_snapshot_t* out, int64_t* latch_us);
 int32_t   ky040_get_ticks(ky040_handle_t h);
 uint16_t  ky040_get_angle(ky040_handle_t h);
+int64_t   ky040_get_position(ky040_handle_t h);    // full 64-bit tick count
+// Output shaft angle in degrees, Q16.16 (multi-turn, no wrap). Divide-free.
+int64_t   ky040_get_angle_q16(ky040_handle_t h);
+// Signed speed in 1/1000 ticks per second: 1/T of the last edge when slow,
+// net edges over the last few edge timestamps when fast.
+esp_err_t ky040_get_velocity(ky040_handle_t h, int32_t* mticks_per_s);
+esp_err_t ky040_get_stats(ky040_handle_t h, ky040_stats_t* out);
+void      ky040_reset_stats(ky040_handle_t h);       // edge count is kept
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,192 @@
+#include "encoder_driver.h"
+#include "ky040_priv.h"
+#include "driver/rmt_rx.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include <stdlib.h>
+
+#define KY040_RMT_TAG "KY040RMT"
+
+#define KY040_RMT_RES_HZ       1000000   // 1 tick = 1 us, the esp_timer time base
+#define KY040_RMT_SYMBOLS      48        // receive buffer per line (one C3 memory block)
+#define KY040_RMT_EDGE_RING    256       // captured edges waiting for ky040_rmt_process (power of two)
+
+typedef struct {
+    int64_t t_us;
+    uint8_t level;
+} rmt_edge_t;
+
+// One RX channel. The receive callback produces edges, ky040_rmt_process
+// consumes them: single producer, single consumer, no lock.
+typedef struct {
+    rmt_channel_handle_t chan;
+    rmt_receive_config_t rx_cfg;
+    rmt_symbol_word_t buf[KY040_RMT_SYMBOLS];
+    uint32_t idle_us;
+    int64_t cursor_us;            // time where the next delivered symbol starts
+    bool in_frame;                // a frame has been partially delivered
+    volatile uint32_t head, tail;
+    volatile uint32_t dropped;    // ring full
+    rmt_edge_t ring[KY040_RMT_EDGE_RING];
+} rmt_line_t;
+
+typedef struct {
+    ky040_handle_t enc;
+    uint32_t lag_us;
+    uint8_t level[2];             // last decoded CLK, DT
+    rmt_line_t line[2];           // CLK, DT
+} rmt_backend_t;
+
+// Called from the IRAM receive callback, IRAM in case it is not inlined
+static inline void IRAM_ATTR _ring_push(rmt_line_t* l, int64_t t, uint8_t level) {
+    if (l->head - l->tail >= KY040_RMT_EDGE_RING) {
+        l->dropped++;
+        return;
+    }
+    rmt_edge_t* slot = &l->ring[l->head & (KY040_RMT_EDGE_RING - 1)];
+    slot->t_us = t;
+    slot->level = level;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    l->head++;
+}
+
+// Every (level, duration) half-symbol starts with an edge into that level; a
+// zero duration marks the end of the frame (the line went idle).
+static bool IRAM_ATTR _rx_done(rmt_channel_handle_t chan, const rmt_rx_done_event_data_t* ev, void* user_ctx) {
+    rmt_line_t* l = (rmt_line_t*)user_ctx;
+    int64_t now = esp_timer_get_time();
+    bool last = ev->flags.is_last;
+
+    int64_t t = l->cursor_us;
+    if (!l->in_frame) {
+        // Anchor a new frame backwards from now: the last edge is idle_us old
+        // when the frame ended, roughly now when the buffer filled up.
+        uint32_t total = 0;
+        for (size_t i = 0; i < ev->num_symbols; i++) {
+            const rmt_symbol_word_t* s = &ev->received_symbols[i];
+            total += s->duration0;
+            if (s->duration0 == 0) break;
+            total += s->duration1;
+            if (s->duration1 == 0) break;
+        }
+        t = now - total - (last ? l->idle_us : 0);
+    }
+
+    for (size_t i = 0; i < ev->num_symbols; i++) {
+        const rmt_symbol_word_t* s = &ev->received_symbols[i];
+        _ring_push(l, t, s->level0);
+        if (s->duration0 == 0) break;
+        t += s->duration0;
+        _ring_push(l, t, s->level1);
+        if (s->duration1 == 0) break;
+        t += s->duration1;
+    }
+    l->cursor_us = t;
+    l->in_frame = !last;
+
+    if (last) rmt_receive(chan, l->buf, sizeof(l->buf), &l->rx_cfg);
+    return false;
+}
+
+static esp_err_t _line_init(rmt_line_t* l, gpio_num_t pin, const ky040_rmt_config_t* rc) {
+    rmt_rx_channel_config_t ch_cfg = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = KY040_RMT_RES_HZ,
+        .mem_block_symbols = KY040_RMT_SYMBOLS,
+    };
+    ESP_RETURN_ON_ERROR(rmt_new_rx_channel(&ch_cfg, &l->chan), KY040_RMT_TAG, "rx channel");
+
+    rmt_rx_event_callbacks_t cbs = {
+        .on_recv_done = _rx_done,
+    };
+    ESP_RETURN_ON_ERROR(rmt_rx_register_event_callbacks(l->chan, &cbs, l), KY040_RMT_TAG, "callbacks");
+    ESP_RETURN_ON_ERROR(rmt_enable(l->chan), KY040_RMT_TAG, "enable");
+
+    l->idle_us = rc->idle_us;
+    l->rx_cfg = (rmt_receive_config_t){
+        .signal_range_min_ns = rc->filter_ns,
+        .signal_range_max_ns = rc->idle_us * 1000u,
+        .flags.en_partial_rx = true,
+    };
+    return rmt_receive(l->chan, l->buf, sizeof(l->buf), &l->rx_cfg);
+}
+
+static void _backend_del(void* arg) {
+    rmt_backend_t* b = (rmt_backend_t*)arg;
+    for (int i = 0; i < 2; i++) {
+        if (!b->line[i].chan) continue;
+        rmt_disable(b->line[i].chan);
+        rmt_del_channel(b->line[i].chan);
+    }
+    free(b);
+}
+
+esp_err_t ky040_create_rmt(const ky040_config_t* cfg, const ky040_rmt_config_t* rmt, ky040_handle_t* out) {
+    if (!cfg || !out) return ESP_ERR_INVALID_ARG;
+    ky040_rmt_config_t rc = rmt ? *rmt : (ky040_rmt_config_t){ 0 };
+    if (rc.filter_ns == 0) rc.filter_ns = 1000;
+    if (rc.idle_us == 0)   rc.idle_us = 200;
+    if (rc.lag_us == 0)    rc.lag_us = 2 * KY040_RMT_SYMBOLS * rc.idle_us;
+
+    rmt_backend_t* b = (rmt_backend_t*)calloc(1, sizeof(*b));
+    if (!b) return ESP_ERR_NO_MEM;
+    b->lag_us = rc.lag_us;
+
+    ky040_handle_t h = NULL;
+    esp_err_t err = ky040_priv_create(cfg, false, &h);
+    if (err != ESP_OK) {
+        free(b);
+        return err;
+    }
+    b->enc = h;
+    b->level[0] = gpio_get_level(cfg->gpio_clk);
+    b->level[1] = gpio_get_level(cfg->gpio_dt);
+    ky040_priv_set_backend(h, b, _backend_del);
+
+    err = _line_init(&b->line[0], cfg->gpio_clk, &rc);
+    if (err == ESP_OK) err = _line_init(&b->line[1], cfg->gpio_dt, &rc);
+    if (err != ESP_OK) {
+        ky040_delete(h);
+        return err;
+    }
+
+    *out = h;
+    return ESP_OK;
+}
+
+esp_err_t ky040_rmt_process(ky040_handle_t h) {
+    if (!h) return ESP_ERR_INVALID_ARG;
+    rmt_backend_t* b = (rmt_backend_t*)ky040_priv_get_backend(h);
+    if (!b) return ESP_ERR_INVALID_STATE;
+
+    // Edges older than the cutoff have been delivered on both lines and are
+    // merged by time. Each line's frames are anchored to its own callback
+    // time, so two edges closer than the difference in callback latency
+    // can still come out swapped.
+    int64_t cutoff = esp_timer_get_time() - b->lag_us;
+    for (;;) {
+        int which = -1;
+        const rmt_edge_t* next = NULL;
+        for (int i = 0; i < 2; i++) {
+            rmt_line_t* l = &b->line[i];
+            if (l->tail == l->head) continue;
+            const rmt_edge_t* ev = &l->ring[l->tail & (KY040_RMT_EDGE_RING - 1)];
+            if (ev->t_us > cutoff) continue;
+            if (!next || ev->t_us < next->t_us) {
+                next = ev;
+                which = i;
+            }
+        }
+        if (!next) break;
+
+        int64_t t = next->t_us;
+        b->level[which] = next->level;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        b->line[which].tail++;
+        ky040_priv_feed(h, (uint8_t)((b->level[0] << 1) | b->level[1]), t);
+    }
+    ky040_priv_feed_done(h, cutoff);
+    return ESP_OK;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "encoder_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared by the decode backends inside this component only.
+
+// gpio_isr = false: pins are configured as plain inputs and no GPIO interrupt
+// is registered; the backend delivers level changes through ky040_priv_feed.
+// Always X4, SW is not used.
+esp_err_t ky040_priv_create(const ky040_config_t* cfg, bool gpio_isr, ky040_handle_t* out);
+// Backend state released by ky040_delete()
+void      ky040_priv_set_backend(ky040_handle_t h, void* backend, void (*del)(void* backend));
+void*     ky040_priv_get_backend(ky040_handle_t h);
+// One level change, state = (CLK << 1) | DT, t_us on the esp_timer time base
+void      ky040_priv_feed(ky040_handle_t h, uint8_t state, int64_t t_us);
+// Every edge up to t_us has been fed; velocity ages the last edge against it
+void      ky040_priv_feed_done(ky040_handle_t h, int64_t t_us);
+
+#ifdef __cplusplus
+}
+#endif
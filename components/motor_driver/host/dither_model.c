@@ -0,0 +1,133 @@
+// Host model of the dithered high-resolution duty (motor_apply_q16)
+//
+// Runs motor_dither.h, the code the driver runs, against a model of the
+// LEDC: the control loop writes a duty at its own rate, every PWM period
+// outputs the last duty written before it started. Reports how close the
+// per-period output averages to the Q16 request, with and without dither.
+//
+// Build (from components/motor_driver):
+//   cc -O2 -Wall -Ipriv_include host/dither_model.c -o /tmp/dither_model -lm
+//
+// Run:
+//   /tmp/dither_model                     default suite, non-zero exit on regression
+//   /tmp/dither_model --pwm 20000 --bits 11 --rate 1000 --window 32
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motor_dither.h"
+
+typedef struct {
+    uint32_t pwm_hz;
+    uint32_t bits;          // LEDC duty resolution
+    uint32_t rate_hz;       // motor_apply_q16 calls per second
+    uint32_t window;        // averaging window, in control updates
+} model_t;
+
+typedef struct {
+    double mean_err;        // worst long-run mean error over all targets, Q16 units
+    double window_err;      // worst error of any window mean, Q16 units
+} result_t;
+
+#define MODEL_UPDATES   4096
+#define MODEL_TARGETS   512
+
+// Average error of the PWM output against duty_q16 for one target
+static void _run_target(const model_t* m, uint32_t duty_q16, bool dither, result_t* r) {
+    static uint32_t out[MODEL_UPDATES];
+    motor_dither_t d = { 0 };
+    for (uint32_t j = 0; j < MODEL_UPDATES; j++) {
+        out[j] = dither ? motor_dither_step(&d, duty_q16, m->bits)
+                        : (uint32_t)(((uint64_t)duty_q16 << m->bits) >> 16);
+    }
+
+    // PWM period k starts at k / pwm_hz and latches write floor(k * rate / pwm)
+    uint64_t periods = (uint64_t)MODEL_UPDATES * m->pwm_hz / m->rate_hz;
+    uint64_t win = (uint64_t)m->window * m->pwm_hz / m->rate_hz;
+    if (win == 0) win = 1;
+    double unit = (double)(1u << (16 - m->bits));   // Q16 units per LEDC count
+    double target = (double)duty_q16 / unit;        // in LEDC counts
+
+    double total = 0, acc = 0;
+    double* ring = calloc(win, sizeof(double));
+    for (uint64_t k = 0; k < periods; k++) {
+        double v = out[k * m->rate_hz / m->pwm_hz];
+        total += v;
+        acc += v - ring[k % win];
+        ring[k % win] = v;
+        if (k + 1 >= win) {
+            double e = fabs(acc / win - target) * unit;
+            if (e > r->window_err) r->window_err = e;
+        }
+    }
+    free(ring);
+    double e = fabs(total / periods - target) * unit;
+    if (e > r->mean_err) r->mean_err = e;
+}
+
+static result_t _run(const model_t* m, bool dither) {
+    result_t r = { 0 };
+    srand(1);
+    const uint32_t edges[] = { 0, 1, 15, 16, 17, 32767, 32768, 65519, 65535, MOTOR_DITHER_ONE };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) _run_target(m, edges[i], dither, &r);
+    for (int i = 0; i < MODEL_TARGETS; i++) _run_target(m, (uint32_t)(rand() % (MOTOR_DITHER_ONE + 1)), dither, &r);
+    return r;
+}
+
+// Effective resolution, capped at the Q16 request itself
+static double _bits(double err_q16) {
+    return err_q16 > 1.0 ? 16.0 - log2(err_q16) : 16.0;
+}
+
+// Checks: the long-run mean is exact to the Q16 LSB, a window of N updates
+// is within one LEDC count / N (+1 count / N for partial periods at its ends)
+static int _report(const model_t* m, bool quiet) {
+    result_t plain = _run(m, false);
+    result_t dith = _run(m, true);
+    double bound = 2.0 * (double)(1u << (16 - m->bits)) / m->window;
+    bool ok = dith.mean_err <= 1.0 && dith.window_err <= bound;
+    if (!quiet) {
+        printf("pwm %6u Hz %2u bit  rate %6u Hz  window %3u:  truncate %5.1f bit  dither mean %5.1f bit, window %5.1f bit  %s\n",
+               m->pwm_hz, m->bits, m->rate_hz, m->window,
+               _bits(plain.window_err), _bits(dith.mean_err), _bits(dith.window_err), ok ? "ok" : "FAIL");
+    }
+    return ok ? 0 : 1;
+}
+
+static const model_t s_suite[] = {
+    {  5000, 10,  1000, 32 },      // the original 5 kHz / 10 bit setup
+    { 20000, 11,  1000, 32 },      // ultrasonic, C3 LEDC limit at 80 MHz
+    { 20000, 11, 10000, 32 },
+    { 25000, 11,  3000, 64 },      // control rate not a divisor of the PWM
+    { 40000, 10,  2000, 64 },
+};
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        int failed = 0;
+        for (size_t i = 0; i < sizeof(s_suite) / sizeof(s_suite[0]); i++) failed += _report(&s_suite[i], false);
+        printf("%s\n", failed ? "REGRESSION" : "all dither models ok");
+        return failed ? 1 : 0;
+    }
+
+    model_t m = { 20000, 11, 1000, 32 };
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if      (v && !strcmp(a, "--pwm"))    { m.pwm_hz = atoi(v); i++; }
+        else if (v && !strcmp(a, "--bits"))   { m.bits = atoi(v); i++; }
+        else if (v && !strcmp(a, "--rate"))   { m.rate_hz = atoi(v); i++; }
+        else if (v && !strcmp(a, "--window")) { m.window = atoi(v); i++; }
+        else {
+            fprintf(stderr, "usage: %s [--pwm hz] [--bits n] [--rate hz] [--window updates]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (m.bits < 1 || m.bits > 14 || m.rate_hz == 0 || m.pwm_hz == 0 || m.window == 0) {
+        fprintf(stderr, "bits 1..14, non-zero rates and window\n");
+        return 2;
+    }
+    return _report(&m, false);
+}
@@ -3,24 +3,178 @@
 
 #include "esp_err.h"
 #include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "hal/adc_types.h"
+
+typedef struct motor_dev_t *motor_handle_t;
+
+#define MOTOR_DUTY_FULL_Q16     (1u << 16)      // 100 % duty, motor_apply_q16
+#define MOTOR_TORQUE_FULL_Q15   (1 << 15)       // full torque command, motor_set_torque
+#define MOTOR_COMP_POINTS       9
+
+typedef enum
+{
+    MOTOR_DIR_COAST = 0,        // both direction pins low
+    MOTOR_DIR_FORWARD = 1,
+    MOTOR_DIR_BACKWARD = -1,
+    MOTOR_DIR_BRAKE = 2,        // both direction pins high
+} motor_dir_t;
+
+// Runs in the LEDC fade ISR when a ramp reaches its target. Return true if
+// it woke a higher-priority task.
+typedef bool (*motor_ramp_done_cb_t)(motor_handle_t motor, uint32_t duty, void *user_ctx);
 
 typedef struct
 {
     gpio_num_t pwm_pin;
     gpio_num_t forward_pin;
     gpio_num_t backward_pin;
+    // Each axis owns one LEDC channel. Axes may share a timer if they use
+    // the same frequency and resolution.
+    ledc_channel_t channel;
+    ledc_timer_t timer;
+    uint32_t freq_hz;                   // 0 = 5 kHz
+    ledc_timer_bit_t duty_resolution;   // 0 = 10 bit
+    // Slew limit: motor_set_speed runs as an LEDC hardware fade no steeper
+    // than this many duty counts per ms. 0 = duty steps at once.
+    uint32_t max_slope;
+    motor_ramp_done_cb_t on_ramp_done;
+    void *user_ctx;
+    // Direction change while driven: PWM off, coast this long, then the
+    // new direction and the commanded duty. 0 = switch at once (PWM still
+    // dropped around the pin change).
+    uint32_t dead_time_us;
+    // Direction pins through a dedicated GPIO bundle (2 of the 8 CPU
+    // output channels), both pins switch in one register write
+    bool dedic_gpio;
 
 } motor_config_t;
 
+// Torque command to duty, per direction: Q16 duty at |torque| = i/8 of full
+// scale, linearly interpolated in between. Point 0 is the breakaway duty,
+// so the smallest non-zero command already overcomes static friction; a
+// zero command is always duty 0. Points must not decrease.
+typedef struct
+{
+    uint32_t fwd[MOTOR_COMP_POINTS];
+    uint32_t bwd[MOTOR_COMP_POINTS];
+} motor_comp_table_t;
+
+// Shaft position in encoder ticks, for motor_calibrate
+typedef int64_t (*motor_position_cb_t)(void *ctx);
+
+typedef struct
+{
+    motor_position_cb_t read_position;
+    void *ctx;
+    uint32_t step_q16;          // duty increase per step, 0 = 1/256
+    uint32_t step_ms;           // dwell per step, 0 = 20 ms
+    uint32_t move_ticks;        // movement that counts as breakaway, 0 = 2
+    uint32_t max_q16;           // give up above this duty, 0 = 100 %
+    uint8_t repeats;            // runs per direction, averaged, 0 = 3
+} motor_calib_config_t;
+
+// I2t winding protection, see motor_thermal_enable. The heat estimate is
+// normalized: 100 % is the steady state at the rated continuous level.
+typedef struct
+{
+    uint32_t tau_ms;            // winding thermal time constant
+    uint32_t rated_q16;         // continuous duty at stall the windings tolerate
+    uint32_t rated_ma;          // continuous current, used with current sensing, 0 = estimate from duty
+    uint8_t foldback_pct;       // heat where the limit starts to fall, 0 = 70 %
+} motor_thermal_config_t;
+
+// Optional current sense on an ADC1 pin (C3: GPIO0-4), see motor_current_attach
+typedef struct
+{
+    gpio_num_t pin;
+    adc_atten_t atten;
+    uint32_t mv_per_amp;        // sense amplifier output per amp
+    int32_t offset_mv;          // output at 0 A
+    uint8_t filter_shift;       // EMA over 1 ms frame means, weight 1/2^shift (0 = frame mean)
+} motor_current_config_t;
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-    esp_err_t motor_driver_init(motor_config_t *config);
-    esp_err_t motor_set_direction(bool forward);
-    esp_err_t motor_set_speed(uint32_t speed);
-    esp_err_t motor_stop(void);
+    esp_err_t motor_create(const motor_config_t *config, motor_handle_t *out);
+    esp_err_t motor_delete(motor_handle_t motor);
+    // Task context. Serialized per motor with the reversal and thermal
+    // timers, so they may be called from several tasks.
+    esp_err_t motor_set_direction(motor_handle_t motor, bool forward);
+    esp_err_t motor_set_speed(motor_handle_t motor, uint32_t speed);
+    esp_err_t motor_stop(motor_handle_t motor);     // coast: immediate, cancels a ramp or reversal
+    // Short brake: both direction pins high, full duty. Leave it with
+    // motor_set_direction (goes through the dead time) or motor_stop.
+    esp_err_t motor_brake(motor_handle_t motor);
+    // Hold the duty where a running ramp is now
+    esp_err_t motor_ramp_stop(motor_handle_t motor);
+    bool motor_is_ramping(motor_handle_t motor);
+    // ISR-safe (IRAM) apply of duty and direction together, e.g. from a
+    // gptimer callback. Writes the LEDC/GPIO registers directly and skips
+    // whatever is unchanged. The duty is latched at the next PWM period,
+    // the pins switch at once (one write with dedic_gpio). No argument
+    // checks, no ramp: call motor_ramp_stop first if one may be running.
+    // Do not call concurrently with the other motor_* functions on the
+    // same handle.
+    esp_err_t motor_apply(motor_handle_t motor, uint32_t duty, motor_dir_t dir);
+    // motor_apply with a Q16 duty (0 .. 65536 = 100 %) at any PWM frequency:
+    // the LEDC count is dithered from one call to the next (first-order
+    // error feedback), so over N calls the mean is within one LEDC count / N
+    // of the request. Call it at a steady control rate.
+    esp_err_t motor_apply_q16(motor_handle_t motor, uint32_t duty_q16, motor_dir_t dir);
+    // Change the PWM frequency at run time. The LEDC resolution becomes the
+    // highest the frequency allows, and every motor on the same LEDC timer
+    // switches with it on one PWM period boundary, duty rescaled. Callers
+    // keep the configured duty_resolution scale for motor_set_speed,
+    // motor_apply and max_slope; motor_apply_q16 gets the full new
+    // resolution. Current sensing restarts on the new frequency.
+    // ESP_ERR_INVALID_ARG if the LEDC divider cannot reach freq_hz. Not
+    // safe against motor_apply* running on an axis of the same timer (they
+    // read the resolution and dither state unlocked): stop that caller first.
+    esp_err_t motor_set_pwm_profile(motor_handle_t motor, uint32_t freq_hz);
+
+    // Torque commands, -MOTOR_TORQUE_FULL_Q15 .. MOTOR_TORQUE_FULL_Q15 (the
+    // sign is the direction), mapped through the compensation table.
+    // Without a table the map is linear, 0 .. 100 % duty.
+    esp_err_t motor_set_comp_table(motor_handle_t motor, const motor_comp_table_t *table);   // NULL = linear
+    void motor_comp_linear(motor_comp_table_t *table, uint32_t fwd_breakaway_q16, uint32_t bwd_breakaway_q16);
+    // Task context, like motor_set_direction + motor_set_speed (dead time, ramp)
+    esp_err_t motor_set_torque(motor_handle_t motor, int32_t torque_q15);
+    // ISR-safe, like motor_apply_q16
+    esp_err_t motor_apply_torque(motor_handle_t motor, int32_t torque_q15);
+    // Self-calibration: from standstill, raise the duty step by step until
+    // the position moves, in each direction (alternating, so the shaft ends
+    // up about where it started). Installs a linear table from the averaged
+    // breakaway duties and copies it to out (may be NULL). Blocks for a few
+    // seconds; the motor is left coasting.
+    esp_err_t motor_calibrate(motor_handle_t motor, const motor_calib_config_t *cfg, motor_comp_table_t *out);
+
+    // Fixed-point I2t model, updated every 10 ms from the duty (stall current
+    // assumed) or the measured current if the motor has current sensing.
+    // While the model is cool the full duty is allowed, short bursts above
+    // rated_q16 included. From foldback_pct heat the duty limit falls
+    // linearly to rated_q16 at 100 %, and below it if the heat still rises.
+    // The limit applies to every drive path, commands above it resume when
+    // the model cools.
+    esp_err_t motor_thermal_enable(motor_handle_t motor, const motor_thermal_config_t *cfg);
+    // Heat in % of the continuous rating, current duty limit (Q16)
+    esp_err_t motor_get_thermal(motor_handle_t motor, uint32_t *heat_pct, uint32_t *limit_q16);
+
+    // Current sensing through the continuous ADC (DMA). One ADC serves every
+    // attached motor: attach all of them, then start. The sample rate is
+    // samples_per_period conversions per axis per PWM period (lowered if the
+    // ADC cannot keep up), and each ~1 ms DMA frame spans whole periods.
+    // Sensed motors must share one PWM frequency.
+    esp_err_t motor_current_attach(motor_handle_t motor, const motor_current_config_t *cfg);
+    esp_err_t motor_current_start(uint32_t samples_per_period);
+    esp_err_t motor_current_stop(void);
+    // Filtered mean and peak (since the last reset) in mA. ESP_ERR_INVALID_STATE
+    // until the first frame is in.
+    esp_err_t motor_get_current(motor_handle_t motor, int32_t *avg_ma, int32_t *peak_ma);
+    void motor_reset_current_peak(motor_handle_t motor);
 
 #ifdef __cplusplus
 }
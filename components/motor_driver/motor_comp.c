@@ -0,0 +1,100 @@
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "motor_driver.h"
+
+#define TAG "motor_comp"
+
+#define MOTOR_CALIB_SETTLE_MS   200
+
+void motor_comp_linear(motor_comp_table_t *table, uint32_t fwd_breakaway_q16, uint32_t bwd_breakaway_q16)
+{
+    for (int i = 0; i < MOTOR_COMP_POINTS; i++)
+    {
+        uint32_t span = MOTOR_DUTY_FULL_Q16 - fwd_breakaway_q16;
+        table->fwd[i] = fwd_breakaway_q16 + span * i / (MOTOR_COMP_POINTS - 1);
+        span = MOTOR_DUTY_FULL_Q16 - bwd_breakaway_q16;
+        table->bwd[i] = bwd_breakaway_q16 + span * i / (MOTOR_COMP_POINTS - 1);
+    }
+}
+
+// Raise the duty from zero until the shaft moves. The duty found is the
+// static (breakaway) level: the one the controller needs for a small error.
+static esp_err_t motor_breakaway(motor_handle_t motor, const motor_calib_config_t *cfg, motor_dir_t dir, uint32_t *duty_q16)
+{
+    motor_apply(motor, 0, MOTOR_DIR_COAST);
+    vTaskDelay(pdMS_TO_TICKS(MOTOR_CALIB_SETTLE_MS));
+
+    int64_t start = cfg->read_position(cfg->ctx);
+    for (uint32_t duty = cfg->step_q16; duty <= cfg->max_q16; duty += cfg->step_q16)
+    {
+        // Repeated within the dwell so the dither averages out
+        for (uint32_t ms = 0; ms < cfg->step_ms; ms += portTICK_PERIOD_MS)
+        {
+            motor_apply_q16(motor, duty, dir);
+            vTaskDelay(1);
+        }
+        if (llabs(cfg->read_position(cfg->ctx) - start) >= cfg->move_ticks)
+        {
+            motor_apply(motor, 0, MOTOR_DIR_COAST);
+            *duty_q16 = duty;
+            return ESP_OK;
+        }
+    }
+    motor_apply(motor, 0, MOTOR_DIR_COAST);
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t motor_calibrate(motor_handle_t motor, const motor_calib_config_t *cfg, motor_comp_table_t *out)
+{
+    if (!motor || !cfg || !cfg->read_position)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    motor_calib_config_t c = *cfg;
+    if (!c.step_q16) c.step_q16 = MOTOR_DUTY_FULL_Q16 / 256;
+    if (!c.step_ms) c.step_ms = 20;
+    if (!c.move_ticks) c.move_ticks = 2;
+    if (!c.max_q16 || c.max_q16 > MOTOR_DUTY_FULL_Q16) c.max_q16 = MOTOR_DUTY_FULL_Q16;
+    if (!c.repeats) c.repeats = 3;
+
+    motor_ramp_stop(motor);
+    uint32_t fwd = 0, bwd = 0;
+    for (int i = 0; i < c.repeats; i++)
+    {
+        uint32_t duty;
+        esp_err_t ret = motor_breakaway(motor, &c, MOTOR_DIR_FORWARD, &duty);
+        if (ret == ESP_OK)
+        {
+            fwd += duty;
+            ret = motor_breakaway(motor, &c, MOTOR_DIR_BACKWARD, &duty);
+        }
+        if (ret == ESP_OK)
+        {
+            bwd += duty;
+        }
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "no movement up to %lu/65536 duty", (unsigned long)c.max_q16);
+            return ret;
+        }
+    }
+    fwd /= c.repeats;
+    bwd /= c.repeats;
+    // The motion sets in somewhere within the last step
+    fwd = fwd > c.step_q16 / 2 ? fwd - c.step_q16 / 2 : 0;
+    bwd = bwd > c.step_q16 / 2 ? bwd - c.step_q16 / 2 : 0;
+    ESP_LOGI(TAG, "breakaway: forward %lu%%, backward %lu%%",
+             (unsigned long)(fwd * 100 / MOTOR_DUTY_FULL_Q16), (unsigned long)(bwd * 100 / MOTOR_DUTY_FULL_Q16));
+
+    motor_comp_table_t table;
+    motor_comp_linear(&table, fwd, bwd);
+    if (out)
+    {
+        *out = table;
+    }
+    return motor_set_comp_table(motor, &table);
+}
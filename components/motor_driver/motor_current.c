@@ -0,0 +1,338 @@
+#include <string.h>
+
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "soc/soc_caps.h"
+
+#include "motor_driver.h"
+#include "motor_priv.h"
+
+#define TAG "motor_current"
+
+#define MOTOR_SENSE_MAX         4
+#define MOTOR_SENSE_CHAN_MAX    8       // ADC1 channels
+#define MOTOR_SENSE_FRAME_HZ    1000    // DMA frames (and filter updates) per second
+#define MOTOR_SENSE_FRAME_MAX   4092    // bytes, one DMA descriptor
+
+// One sensed axis. The frame ISR writes avg_q4/peak_raw, readers convert.
+typedef struct
+{
+    motor_handle_t motor;
+    motor_current_config_t cfg;
+    adc_channel_t channel;
+    adc_cali_handle_t cali;
+    volatile uint32_t avg_q4;       // filtered raw average, Q4
+    volatile uint16_t peak_raw;
+    bool primed;
+} motor_sense_t;
+
+// The C3 has one continuous-mode ADC: this module owns it for all motors
+static motor_sense_t s_sense[MOTOR_SENSE_MAX];
+static int s_sense_count = 0;
+static int8_t s_chan_slot[MOTOR_SENSE_CHAN_MAX];
+static adc_continuous_handle_t s_adc = NULL;
+static uint32_t s_per_period = 0;      // as passed to motor_current_start
+
+// Full-scale pin voltage per attenuation, used when no eFuse calibration
+static const uint16_t s_full_scale_mv[] = { 750, 1050, 1300, 2500 };
+
+static motor_sense_t *motor_sense_find(motor_handle_t motor)
+{
+    for (int i = 0; i < s_sense_count; i++)
+    {
+        if (s_sense[i].motor == motor)
+        {
+            return &s_sense[i];
+        }
+    }
+    return NULL;
+}
+
+// One DMA frame covers whole PWM periods, so its mean carries no ripple
+// phase bias. Per frame: mean per axis into the EMA, per sample: peak.
+static bool IRAM_ATTR motor_current_frame(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    uint32_t sum[MOTOR_SENSE_MAX] = { 0 };
+    uint32_t n[MOTOR_SENSE_MAX] = { 0 };
+    const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)edata->conv_frame_buffer;
+    uint32_t count = edata->size / SOC_ADC_DIGI_RESULT_BYTES;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t ch = p[i].type2.channel;
+        if (p[i].type2.unit != 0 || ch >= MOTOR_SENSE_CHAN_MAX || s_chan_slot[ch] < 0)
+        {
+            continue;
+        }
+        int slot = s_chan_slot[ch];
+        uint16_t d = p[i].type2.data;
+        sum[slot] += d;
+        n[slot]++;
+        if (d > s_sense[slot].peak_raw)
+        {
+            s_sense[slot].peak_raw = d;
+        }
+    }
+
+    for (int i = 0; i < s_sense_count; i++)
+    {
+        if (!n[i])
+        {
+            continue;
+        }
+        motor_sense_t *s = &s_sense[i];
+        int32_t avg = (int32_t)((sum[i] << 4) / n[i]);
+        if (!s->primed)
+        {
+            s->avg_q4 = avg;
+            s->primed = true;
+            continue;
+        }
+        int32_t cur = (int32_t)s->avg_q4;
+        s->avg_q4 = (uint32_t)(cur + ((avg - cur) >> s->cfg.filter_shift));
+    }
+    return false;
+}
+
+static int32_t motor_sense_mv(const motor_sense_t *s, uint32_t raw_q4)
+{
+    int raw = raw_q4 >> 4;
+    int frac = raw_q4 & 15;
+    if (!s->cali)
+    {
+        uint32_t fs = s_full_scale_mv[s->cfg.atten < 4 ? s->cfg.atten : 3];
+        return (int32_t)((uint64_t)raw_q4 * fs / (4095u << 4));
+    }
+    int v0 = 0, v1 = 0;
+    adc_cali_raw_to_voltage(s->cali, raw, &v0);
+    adc_cali_raw_to_voltage(s->cali, raw < 4095 ? raw + 1 : raw, &v1);
+    return v0 + (v1 - v0) * frac / 16;
+}
+
+static int32_t motor_sense_ma(const motor_sense_t *s, uint32_t raw_q4)
+{
+    int32_t mv = motor_sense_mv(s, raw_q4) - s->cfg.offset_mv;
+    return (int32_t)((int64_t)mv * 1000 / (int32_t)s->cfg.mv_per_amp);
+}
+
+esp_err_t motor_current_attach(motor_handle_t motor, const motor_current_config_t *cfg)
+{
+    if (!motor || !cfg || cfg->mv_per_amp == 0 || cfg->filter_shift > 15)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_adc)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (motor_sense_find(motor) || s_sense_count >= MOTOR_SENSE_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    adc_unit_t unit;
+    adc_channel_t channel;
+    ESP_RETURN_ON_ERROR(adc_continuous_io_to_channel(cfg->pin, &unit, &channel), TAG, "not an ADC pin");
+    if (unit != ADC_UNIT_1)
+    {
+        ESP_LOGE(TAG, "pin %d: only ADC1 works in continuous mode", cfg->pin);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    motor_sense_t *s = &s_sense[s_sense_count];
+    memset(s, 0, sizeof(*s));
+    s->motor = motor;
+    s->cfg = *cfg;
+    s->channel = channel;
+
+    adc_cali_curve_fitting_config_t cali_cfg = {
+        .unit_id = ADC_UNIT_1,
+        .chan = channel,
+        .atten = cfg->atten,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    if (adc_cali_create_scheme_curve_fitting(&cali_cfg, &s->cali) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "no ADC calibration, using nominal full scale");
+        s->cali = NULL;
+    }
+    s_sense_count++;
+    return ESP_OK;
+}
+
+// The scan pattern covers every sensed motor: stop, drop this one and
+// restart for the others
+void motor_priv_current_detach(motor_handle_t motor)
+{
+    motor_sense_t *s = motor_sense_find(motor);
+    if (!s)
+    {
+        return;
+    }
+    bool running = s_adc != NULL;
+    motor_current_stop();
+    if (s->cali)
+    {
+        adc_cali_delete_scheme_curve_fitting(s->cali);
+    }
+    *s = s_sense[--s_sense_count];
+    if (running && s_sense_count > 0 && motor_current_start(s_per_period) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "current sampling did not restart");
+    }
+}
+
+esp_err_t motor_current_start(uint32_t samples_per_period)
+{
+    if (s_adc)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_sense_count == 0 || samples_per_period == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The ADC cannot be triggered by the LEDC, so sample at an integer
+    // multiple of the PWM frequency instead: every frame then spans whole
+    // PWM periods with the same number of samples at each phase.
+    uint32_t pwm_hz = motor_priv_pwm_freq(s_sense[0].motor);
+    for (int i = 1; i < s_sense_count; i++)
+    {
+        if (motor_priv_pwm_freq(s_sense[i].motor) != pwm_hz)
+        {
+            ESP_LOGE(TAG, "sensed motors must share one PWM frequency");
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    uint32_t per_period = samples_per_period * s_sense_count;
+    while (pwm_hz * per_period > SOC_ADC_SAMPLE_FREQ_THRES_HIGH && per_period > (uint32_t)s_sense_count)
+    {
+        per_period -= s_sense_count;
+    }
+    while (pwm_hz * per_period < SOC_ADC_SAMPLE_FREQ_THRES_LOW)
+    {
+        per_period += s_sense_count;
+    }
+    uint32_t rate = pwm_hz * per_period;
+    if (rate > SOC_ADC_SAMPLE_FREQ_THRES_HIGH)
+    {
+        ESP_LOGE(TAG, "%lu Hz PWM is too fast to sample", (unsigned long)pwm_hz);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t periods = pwm_hz / MOTOR_SENSE_FRAME_HZ;
+    if (periods == 0)
+    {
+        periods = 1;
+    }
+    while (periods > 1 && periods * per_period * SOC_ADC_DIGI_RESULT_BYTES > MOTOR_SENSE_FRAME_MAX)
+    {
+        periods--;
+    }
+    uint32_t frame = periods * per_period * SOC_ADC_DIGI_RESULT_BYTES;
+
+    adc_digi_pattern_config_t pattern[MOTOR_SENSE_MAX] = { 0 };
+    memset(s_chan_slot, -1, sizeof(s_chan_slot));
+    for (int i = 0; i < s_sense_count; i++)
+    {
+        pattern[i].atten = s_sense[i].cfg.atten;
+        pattern[i].channel = s_sense[i].channel;
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        s_chan_slot[s_sense[i].channel] = i;
+        s_sense[i].primed = false;
+    }
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = frame * 4,
+        .conv_frame_size = frame,
+    };
+    ESP_RETURN_ON_ERROR(adc_continuous_new_handle(&handle_cfg, &s_adc), TAG, "adc_continuous_new_handle");
+
+    adc_continuous_config_t adc_cfg = {
+        .pattern_num = s_sense_count,
+        .adc_pattern = pattern,
+        .sample_freq_hz = rate,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = motor_current_frame,
+    };
+    esp_err_t ret = adc_continuous_config(s_adc, &adc_cfg);
+    if (ret == ESP_OK)
+    {
+        ret = adc_continuous_register_event_callbacks(s_adc, &cbs, NULL);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = adc_continuous_start(s_adc);
+    }
+    if (ret != ESP_OK)
+    {
+        adc_continuous_deinit(s_adc);
+        s_adc = NULL;
+        return ret;
+    }
+    s_per_period = samples_per_period;
+    ESP_LOGI(TAG, "%d axes, %lu Hz, %lu samples per PWM period, %lu periods per frame", s_sense_count,
+             (unsigned long)rate, (unsigned long)per_period, (unsigned long)periods);
+    return ESP_OK;
+}
+
+esp_err_t motor_priv_current_retune(void)
+{
+    if (!s_adc)
+    {
+        return ESP_OK;
+    }
+    motor_current_stop();
+    return motor_current_start(s_per_period);
+}
+
+esp_err_t motor_current_stop(void)
+{
+    if (!s_adc)
+    {
+        return ESP_OK;
+    }
+    adc_continuous_stop(s_adc);
+    esp_err_t ret = adc_continuous_deinit(s_adc);
+    s_adc = NULL;
+    return ret;
+}
+
+esp_err_t motor_get_current(motor_handle_t motor, int32_t *avg_ma, int32_t *peak_ma)
+{
+    motor_sense_t *s = motor_sense_find(motor);
+    if (!s)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!s->primed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (avg_ma)
+    {
+        *avg_ma = motor_sense_ma(s, s->avg_q4);
+    }
+    if (peak_ma)
+    {
+        *peak_ma = motor_sense_ma(s, (uint32_t)s->peak_raw << 4);
+    }
+    return ESP_OK;
+}
+
+void motor_reset_current_peak(motor_handle_t motor)
+{
+    motor_sense_t *s = motor_sense_find(motor);
+    if (s)
+    {
+        s->peak_raw = 0;
+    }
+}
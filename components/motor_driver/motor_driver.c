@@ -1,36 +1,343 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "driver/ledc.h"
+#include "hal/ledc_ll.h"
+#include "hal/gpio_ll.h"
+#include "hal/dedic_gpio_cpu_ll.h"
+#include "driver/dedic_gpio.h"
+#include "esp_attr.h"
+#include "esp_clk_tree.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "motor_driver.h"
+#include "motor_priv.h"
+#include "motor_dither.h"
 
 #define TAG "motor_driver"
 
-static motor_config_t motor = {0};
+#define MOTOR_DEFAULT_FREQ_HZ   5000
+#define MOTOR_DEFAULT_DUTY_RES  LEDC_TIMER_10_BIT
+#define MOTOR_THERMAL_TICK_MS   10
+// LEDC timer divider, 10.8 fixed point (ledc_timer_config's bounds)
+#define MOTOR_LEDC_DIV_MIN      (1u << LEDC_LL_FRACTIONAL_BITS)
+#define MOTOR_LEDC_DIV_MAX      0x3FFFF
 
-esp_err_t motor_driver_init(motor_config_t *config)
+
+struct motor_dev_t
 {
-    esp_err_t ret = ESP_OK;
+    gpio_num_t pwm_pin;
+    gpio_num_t forward_pin;
+    gpio_num_t backward_pin;
+    ledc_channel_t channel;
+    ledc_timer_t timer;
+    // Serializes the driver path (API calls, reversal and thermal timers):
+    // they reach the LEDC fade driver, which may block, so not a spinlock.
+    // The ISR register path (motor_apply*) does not take it.
+    SemaphoreHandle_t lock;
+    // Last applied outputs, shared by the driver calls and the ISR fast path
+    volatile uint32_t duty;
+    volatile int8_t dir;               // motor_dir_t
+    // Direction pins as a dedicated GPIO bundle: bit 0 forward, bit 1 backward
+    dedic_gpio_bundle_handle_t bundle;
+    uint32_t dedic_shift;              // bundle position in the CPU output register
+    uint32_t duty_max;
+    uint8_t duty_bits;                 // current LEDC resolution, see motor_set_pwm_profile
+    uint8_t user_bits;                 // caller duty scale: the configured resolution
+    motor_dither_t dither;             // motor_apply_q16 remainder
+    // Reversal: PWM off, coast for dead_time_us, new direction, duty restored
+    uint32_t dead_time_us;
+    esp_timer_handle_t rev_timer;
+    volatile bool in_deadtime;
+    volatile int8_t pending_dir;
+    volatile uint32_t target;          // commanded duty, restored after dead time
+    volatile bool direct;              // target came from motor_apply* (register path)
+    int64_t off_us;                    // when the bridge was last switched off (both paths)
+    // Hardware fade ramps
+    uint32_t max_slope;                // duty counts per ms, 0 = step changes
+    volatile bool ramping;
+    volatile bool fade_cfg;            // channel holds fade step settings
+    motor_ramp_done_cb_t on_ramp_done;
+    void *user_ctx;
+    // Torque command map, see motor_set_comp_table
+    bool comp_on;
+    motor_comp_table_t comp;
+    // I2t model, see motor_thermal_enable
+    motor_thermal_config_t thermal;
+    esp_timer_handle_t thermal_timer;
+    int64_t heat_q32;                  // 1.0 = steady state at the rated level
+    volatile uint32_t limit_q16;       // duty limit, MOTOR_DUTY_FULL_Q16 = none
+    bool thermal_clamped;
+    bool deleting;                     // set under the lock: timer callbacks leave at once
+};
+
+// LEDC ownership across axes: one handle per channel, timers shared only
+// with an identical configuration. Create/delete motors from one task.
+typedef struct
+{
+    uint8_t users;
+    uint32_t freq_hz;
+    ledc_timer_bit_t duty_resolution;
+} motor_timer_t;
+
+static struct motor_dev_t *s_motors[LEDC_CHANNEL_MAX];
+static motor_timer_t s_timers[LEDC_TIMER_MAX];
+static bool s_fade_installed = false;
+static portMUX_TYPE s_ledc_lock = portMUX_INITIALIZER_UNLOCKED;
+// The dedicated GPIO output CSR is shared by every bundle
+static portMUX_TYPE s_dedic_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline void motor_lock(struct motor_dev_t *motor)
+{
+    xSemaphoreTake(motor->lock, portMAX_DELAY);
+}
+
+static inline void motor_unlock(struct motor_dev_t *motor)
+{
+    xSemaphoreGive(motor->lock);
+}
+
+// Duty from one resolution to another, rounded
+static inline uint32_t IRAM_ATTR motor_rescale(uint32_t duty, uint32_t from_bits, uint32_t to_bits)
+{
+    if (to_bits >= from_bits)
+    {
+        return duty << (to_bits - from_bits);
+    }
+    uint32_t s = from_bits - to_bits;
+    return (duty + (1u << (s - 1))) >> s;
+}
+
+// Caller duty (configured resolution) to LEDC counts
+static inline uint32_t IRAM_ATTR motor_hw_duty(const struct motor_dev_t *motor, uint32_t duty)
+{
+    return motor_rescale(duty, motor->user_bits, motor->duty_bits);
+}
+
+static esp_err_t motor_timer_acquire(ledc_timer_t timer, uint32_t freq_hz, ledc_timer_bit_t res)
+{
+    motor_timer_t *t = &s_timers[timer];
+    if (t->users)
+    {
+        if (t->freq_hz != freq_hz || t->duty_resolution != res)
+        {
+            ESP_LOGE(TAG, "timer %d already runs %lu Hz / %d bit", timer, (unsigned long)t->freq_hz, t->duty_resolution);
+            return ESP_ERR_INVALID_STATE;
+        }
+        t->users++;
+        return ESP_OK;
+    }
 
     ledc_timer_config_t ledc_timer = {
         .speed_mode       = LEDC_LOW_SPEED_MODE,
-        .timer_num        = LEDC_TIMER_0,
-        .duty_resolution  = LEDC_TIMER_10_BIT,
-        .freq_hz          = 5000,
-        .clk_cfg          = LEDC_AUTO_CLK
+        .timer_num        = timer,
+        .duty_resolution  = res,
+        .freq_hz          = freq_hz,
+        .clk_cfg          = LEDC_USE_APB_CLK   // motor_set_pwm_profile computes dividers against it
     };
-    ret = ledc_timer_config(&ledc_timer);
+    esp_err_t ret = ledc_timer_config(&ledc_timer);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "ledc_timer_config failed");
         return ret;
     }
+    t->users = 1;
+    t->freq_hz = freq_hz;
+    t->duty_resolution = res;
+    return ESP_OK;
+}
+
+static bool IRAM_ATTR motor_fade_done(const ledc_cb_param_t *param, void *arg)
+{
+    struct motor_dev_t *motor = (struct motor_dev_t *)arg;
+    if (param->event != LEDC_FADE_END_EVT)
+    {
+        return false;
+    }
+    motor->ramping = false;
+    if (!motor->on_ramp_done)
+    {
+        return false;
+    }
+    return motor->on_ramp_done(motor, param->duty, motor->user_ctx);
+}
+
+static esp_err_t motor_fade_init(struct motor_dev_t *motor)
+{
+    if (!s_fade_installed)
+    {
+        esp_err_t ret = ledc_fade_func_install(0);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            ESP_LOGE(TAG, "ledc_fade_func_install failed");
+            return ret;
+        }
+        s_fade_installed = true;
+    }
+    ledc_cbs_t cbs = {
+        .fade_cb = motor_fade_done,
+    };
+    return ledc_cb_register(LEDC_LOW_SPEED_MODE, motor->channel, &cbs, motor);
+}
+
+// Duty change as a hardware fade no steeper than max_slope. A running ramp
+// is stopped where it is and the new one starts from there, so the control
+// task never waits on the fade engine.
+static esp_err_t motor_ramp_duty(struct motor_dev_t *motor, uint32_t duty)
+{
+    if (motor->ramping)
+    {
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, motor->channel);
+        motor->ramping = false;
+    }
+    uint32_t from = ledc_get_duty(LEDC_LOW_SPEED_MODE, motor->channel);
+    uint32_t delta = duty > from ? duty - from : from - duty;
+    uint32_t ms = motor_rescale(delta, motor->duty_bits, motor->user_bits) / motor->max_slope;
+    if (ms == 0)
+    {
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, motor->channel, duty);
+        return ledc_update_duty(LEDC_LOW_SPEED_MODE, motor->channel);
+    }
+
+    esp_err_t ret = ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, motor->channel, duty, ms);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    motor->fade_cfg = true;
+    motor->ramping = true;
+    return ledc_fade_start(LEDC_LOW_SPEED_MODE, motor->channel, LEDC_FADE_NO_WAIT);
+}
+
+// Drive the direction pins. With a bundle both change in one CPU register
+// write; otherwise the active one is released first so a reversal never
+// passes through both-high. The register is shared with the other axes'
+// bundles, written from tasks, timers and ISRs (motor_apply), so its
+// read-modify-write runs with interrupts off. dedic_gpio_cpu_ll_write_mask
+// would set before it clears: both-high for a moment on a reversal.
+static inline void IRAM_ATTR motor_write_pins(struct motor_dev_t *motor, int8_t dir)
+{
+    bool fwd = (dir == MOTOR_DIR_FORWARD || dir == MOTOR_DIR_BRAKE);
+    bool bwd = (dir == MOTOR_DIR_BACKWARD || dir == MOTOR_DIR_BRAKE);
+    if (motor->bundle) {
+        portENTER_CRITICAL_SAFE(&s_dedic_lock);
+        uint32_t out = dedic_gpio_cpu_ll_read_out() & ~(3u << motor->dedic_shift);
+        dedic_gpio_cpu_ll_write_all(out | ((fwd | (bwd << 1)) << motor->dedic_shift));
+        portEXIT_CRITICAL_SAFE(&s_dedic_lock);
+    } else {
+        gpio_dev_t *gpio = GPIO_LL_GET_HW(GPIO_PORT_0);
+        if (!fwd) gpio_ll_set_level(gpio, motor->forward_pin, 0);
+        if (!bwd) gpio_ll_set_level(gpio, motor->backward_pin, 0);
+        if (fwd) gpio_ll_set_level(gpio, motor->forward_pin, 1);
+        if (bwd) gpio_ll_set_level(gpio, motor->backward_pin, 1);
+    }
+    motor->dir = dir;
+}
+
+// Immediate duty, cancels a ramp
+static void motor_write_duty(struct motor_dev_t *motor, uint32_t duty)
+{
+    if (motor->ramping)
+    {
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, motor->channel);
+        motor->ramping = false;
+    }
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, motor->channel, duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, motor->channel);
+    motor->duty = duty;
+}
+
+// Duty through the ramp if one is configured
+static inline uint32_t IRAM_ATTR motor_duty_limit(const struct motor_dev_t *motor)
+{
+    return motor_rescale(motor->limit_q16, 16, motor->duty_bits);
+}
+
+static esp_err_t motor_drive_duty(struct motor_dev_t *motor, uint32_t duty)
+{
+    uint32_t limit = motor_duty_limit(motor);
+    if (duty > limit) duty = limit;
+    if (motor->duty == duty) return ESP_OK;
+    motor->duty = duty;
+    if (motor->max_slope) return motor_ramp_duty(motor, duty);
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, motor->channel, duty);
+    return ledc_update_duty(LEDC_LOW_SPEED_MODE, motor->channel);
+}
+
+// esp_timer one-shot, end of the reversal dead time. Runs under the motor
+// lock like the API calls; a stop or brake that got the lock first has
+// already ended the dead time, and the expiry is stale.
+static void motor_reverse_done(void *arg)
+{
+    struct motor_dev_t *motor = (struct motor_dev_t *)arg;
+    motor_lock(motor);
+    if (motor->in_deadtime && !motor->deleting)
+    {
+        motor_write_pins(motor, motor->pending_dir);
+        motor->in_deadtime = false;
+        motor_drive_duty(motor, motor->target);
+    }
+    motor_unlock(motor);
+}
+
+static void motor_cancel_reverse(struct motor_dev_t *motor)
+{
+    if (motor->in_deadtime)
+    {
+        esp_timer_stop(motor->rev_timer);
+        motor->in_deadtime = false;
+    }
+}
+
+static void motor_timer_release(ledc_timer_t timer)
+{
+    motor_timer_t *t = &s_timers[timer];
+    if (t->users && --t->users == 0)
+    {
+        ledc_timer_pause(LEDC_LOW_SPEED_MODE, timer);
+    }
+}
+
+esp_err_t motor_create(const motor_config_t *config, motor_handle_t *out)
+{
+    if (!config || !out || config->channel >= LEDC_CHANNEL_MAX || config->timer >= LEDC_TIMER_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t freq_hz = config->freq_hz ? config->freq_hz : MOTOR_DEFAULT_FREQ_HZ;
+    ledc_timer_bit_t res = config->duty_resolution ? config->duty_resolution : MOTOR_DEFAULT_DUTY_RES;
+
+    if (s_motors[config->channel])
+    {
+        ESP_LOGE(TAG, "LEDC channel %d already in use", config->channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    struct motor_dev_t *motor = calloc(1, sizeof(*motor));
+    if (!motor)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    motor->lock = xSemaphoreCreateMutex();
+    if (!motor->lock)
+    {
+        ret = ESP_ERR_NO_MEM;
+        goto err_free;
+    }
+
+    ret = motor_timer_acquire(config->timer, freq_hz, res);
+    if (ret != ESP_OK)
+    {
+        goto err_free;
+    }
 
     ledc_channel_config_t ledc_channel = {
         .speed_mode     = LEDC_LOW_SPEED_MODE,
-        .channel        = LEDC_CHANNEL_0,
-        .timer_sel      = LEDC_TIMER_0,
+        .channel        = config->channel,
+        .timer_sel      = config->timer,
         .intr_type      = LEDC_INTR_DISABLE,
         .gpio_num       = config->pwm_pin,
         .duty           = 0,  // Set duty to 0%
@@ -39,48 +346,582 @@ esp_err_t motor_driver_init(motor_config_t *config)
     ret = ledc_channel_config(&ledc_channel);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "ledc_channel_config failed");
-        return ret;
+        goto err_timer;
+    }
+    motor->pwm_pin = config->pwm_pin;
+    motor->forward_pin = config->forward_pin;
+    motor->backward_pin = config->backward_pin;
+    motor->channel = config->channel;
+    motor->timer = config->timer;
+    motor->max_slope = config->max_slope;
+    motor->duty_max = (1u << res) - 1;
+    motor->duty_bits = res;
+    motor->user_bits = res;
+    motor->limit_q16 = MOTOR_DUTY_FULL_Q16;
+    motor->dead_time_us = config->dead_time_us;
+    motor->on_ramp_done = config->on_ramp_done;
+    motor->user_ctx = config->user_ctx;
+
+    if (motor->max_slope)
+    {
+        ret = motor_fade_init(motor);
+        if (ret != ESP_OK)
+        {
+            goto err_channel_cfg;
+        }
+    }
+    if (motor->dead_time_us)
+    {
+        esp_timer_create_args_t targs = {
+            .callback = motor_reverse_done,
+            .arg = motor,
+            .name = "motor_rev",
+        };
+        ret = esp_timer_create(&targs, &motor->rev_timer);
+        if (ret != ESP_OK)
+        {
+            goto err_channel_cfg;
+        }
     }
-    motor.pwm_pin = config->pwm_pin;
-    motor.forward_pin = config->forward_pin;
-    motor.backward_pin = config->backward_pin;
 
     // Configure GPIO pins for direction control
     gpio_config_t io_conf = {
         .intr_type = GPIO_INTR_DISABLE,
         .mode = GPIO_MODE_OUTPUT,
-        .pin_bit_mask = (1ULL << motor.forward_pin) | (1ULL << motor.backward_pin),
+        .pin_bit_mask = (1ULL << motor->forward_pin) | (1ULL << motor->backward_pin),
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .pull_up_en = GPIO_PULLUP_DISABLE
     };
     ret = gpio_config(&io_conf);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "gpio_config failed");
-        return ret;
+        goto err_rev_timer;
+    }
+    if (config->dedic_gpio)
+    {
+        int pins[2] = { motor->forward_pin, motor->backward_pin };
+        dedic_gpio_bundle_config_t bundle_cfg = {
+            .gpio_array = pins,
+            .array_size = 2,
+            .flags.out_en = 1,
+        };
+        ret = dedic_gpio_new_bundle(&bundle_cfg, &motor->bundle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "dedic_gpio_new_bundle failed");
+            goto err_rev_timer;
+        }
+        dedic_gpio_get_out_offset(motor->bundle, &motor->dedic_shift);
     }
 
+    s_motors[config->channel] = motor;
+    *out = motor;
     return ESP_OK;
+
+err_rev_timer:
+    if (motor->rev_timer) esp_timer_delete(motor->rev_timer);
+err_channel_cfg:
+    ledc_stop(LEDC_LOW_SPEED_MODE, config->channel, 0);
+err_timer:
+    motor_timer_release(config->timer);
+err_free:
+    if (motor->lock) vSemaphoreDelete(motor->lock);
+    free(motor);
+    return ret;
 }
 
-esp_err_t motor_set_direction(bool forward) {
-    gpio_set_level(motor.forward_pin, forward ? 1 : 0);
-    gpio_set_level(motor.backward_pin, forward ? 0 : 1);
+esp_err_t motor_delete(motor_handle_t motor)
+{
+    if (!motor)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    motor_stop(motor);
+    // esp_timer_stop does not wait for a callback in progress, and the
+    // callbacks run under the lock. Mark the motor and stop the timers
+    // under it, then take it once more: a callback that was waiting for it
+    // has run (and left) before the timers and the lock are deleted.
+    motor_lock(motor);
+    motor->deleting = true;
+    if (motor->rev_timer) esp_timer_stop(motor->rev_timer);
+    if (motor->thermal_timer) esp_timer_stop(motor->thermal_timer);
+    motor_unlock(motor);
+    motor_lock(motor);
+    motor_unlock(motor);
+
+    motor_priv_current_detach(motor);
+    if (motor->max_slope)
+    {
+        ledc_cbs_t cbs = { 0 };
+        ledc_cb_register(LEDC_LOW_SPEED_MODE, motor->channel, &cbs, NULL);
+    }
+    if (motor->rev_timer) esp_timer_delete(motor->rev_timer);
+    if (motor->thermal_timer) esp_timer_delete(motor->thermal_timer);
+    if (motor->bundle) dedic_gpio_del_bundle(motor->bundle);
+    ledc_stop(LEDC_LOW_SPEED_MODE, motor->channel, 0);
+    motor_timer_release(motor->timer);
+    s_motors[motor->channel] = NULL;
+    vSemaphoreDelete(motor->lock);
+    free(motor);
     return ESP_OK;
 }
 
-// Set motor speed (0-1023)
-esp_err_t motor_set_speed(uint32_t duty) {
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+uint32_t motor_priv_pwm_freq(motor_handle_t motor)
+{
+    return s_timers[motor->timer].freq_hz;
+}
+
+// Leaving a driven or braked state goes through the reversal sequence:
+// PWM off, coast for dead_time_us, new direction, commanded duty back
+// (through the ramp if configured). From coast only the rest of the dead
+// time since the bridge went off (stop, brake release) is waited. The wait
+// is an esp_timer one-shot, this call does not block on it. Caller holds
+// the motor lock.
+static esp_err_t motor_change_dir(struct motor_dev_t *motor, int8_t dir) {
+    if (motor->in_deadtime) {
+        motor->pending_dir = dir;
+        return ESP_OK;
+    }
+    if (motor->dir == dir) return ESP_OK;
+
+    if (motor->dir == MOTOR_DIR_COAST) {
+        int64_t left = motor->off_us + motor->dead_time_us - esp_timer_get_time();
+        if (!motor->dead_time_us || left <= 0) {
+            motor_write_pins(motor, dir);
+            return ESP_OK;
+        }
+        motor->pending_dir = dir;
+        motor->in_deadtime = true;
+        return esp_timer_start_once(motor->rev_timer, left);
+    }
+    motor_write_duty(motor, 0);
+    if (!motor->dead_time_us) {
+        motor_write_pins(motor, dir);
+        return motor_drive_duty(motor, motor->target);
+    }
+    motor_write_pins(motor, MOTOR_DIR_COAST);
+    motor->off_us = esp_timer_get_time();
+    motor->pending_dir = dir;
+    motor->in_deadtime = true;
+    return esp_timer_start_once(motor->rev_timer, motor->dead_time_us);
+}
+
+esp_err_t motor_set_direction(motor_handle_t motor, bool forward) {
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    motor_lock(motor);
+    esp_err_t ret = motor_change_dir(motor, forward ? MOTOR_DIR_FORWARD : MOTOR_DIR_BACKWARD);
+    motor_unlock(motor);
+    return ret;
+}
+
+// Commanded duty in LEDC counts, held back during dead time and brake.
+// Caller holds the motor lock.
+static esp_err_t motor_set_target(struct motor_dev_t *motor, uint32_t duty)
+{
+    motor->target = duty;
+    motor->direct = false;
+    if (motor->in_deadtime || motor->dir == MOTOR_DIR_BRAKE) return ESP_OK;
+    return motor_drive_duty(motor, duty);
+}
+
+// Set motor speed (0 .. 2^duty_resolution - 1, 0-1023 by default)
+esp_err_t motor_set_speed(motor_handle_t motor, uint32_t duty) {
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    motor_lock(motor);
+    esp_err_t ret = motor_set_target(motor, motor_hw_duty(motor, duty));
+    motor_unlock(motor);
+    return ret;
+}
+
+esp_err_t motor_ramp_stop(motor_handle_t motor)
+{
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    esp_err_t ret = ESP_OK;
+    motor_lock(motor);
+    if (motor->ramping)
+    {
+        ret = ledc_fade_stop(LEDC_LOW_SPEED_MODE, motor->channel);
+        motor->ramping = false;
+        motor->duty = ledc_get_duty(LEDC_LOW_SPEED_MODE, motor->channel);
+    }
+    motor_unlock(motor);
+    return ret;
+}
+
+bool motor_is_ramping(motor_handle_t motor)
+{
+    return motor && motor->ramping;
+}
+
+esp_err_t motor_stop(motor_handle_t motor)
+{
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    // Coast: no ramp, no pending reversal, bridge off
+    motor_lock(motor);
+    motor_cancel_reverse(motor);
+    motor_write_duty(motor, 0);
+    if (motor->dir != MOTOR_DIR_COAST) motor->off_us = esp_timer_get_time();
+    motor_write_pins(motor, MOTOR_DIR_COAST);
+    motor->target = 0;
+    motor_unlock(motor);
+    return ESP_OK;
+}
+
+esp_err_t motor_brake(motor_handle_t motor)
+{
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    // Short brake: both inputs high with the enable fully on shorts the
+    // windings through the bridge (TB6612 short brake, L298 fast stop)
+    motor_lock(motor);
+    motor_cancel_reverse(motor);
+    motor_write_duty(motor, 0);
+    if (motor->dir != MOTOR_DIR_BRAKE) motor->off_us = esp_timer_get_time();   // drive off
+    motor_write_pins(motor, MOTOR_DIR_BRAKE);
+    motor_write_duty(motor, motor->duty_max);
+    motor->target = 0;
+    motor_unlock(motor);
+    return ESP_OK;
+}
+
+// Register-level duty write: no driver locks, no flash access. The value
+// goes through the channel's shadow register and takes effect at the next
+// PWM period. Normally the channel keeps the single-step duty settings left
+// by ledc_set_duty and only the duty value is written; after a fade ramp
+// they are restored once.
+static inline void IRAM_ATTR motor_ll_write_duty(struct motor_dev_t *motor, uint32_t duty)
+{
+    ledc_dev_t *ledc = LEDC_LL_GET_HW();
+    if (motor->fade_cfg) {
+        ledc_ll_set_duty_direction(ledc, LEDC_LOW_SPEED_MODE, motor->channel, LEDC_DUTY_DIR_INCREASE);
+        ledc_ll_set_duty_num(ledc, LEDC_LOW_SPEED_MODE, motor->channel, 1);
+        ledc_ll_set_duty_cycle(ledc, LEDC_LOW_SPEED_MODE, motor->channel, 1);
+        ledc_ll_set_duty_scale(ledc, LEDC_LOW_SPEED_MODE, motor->channel, 0);
+        motor->fade_cfg = false;
+    }
+    ledc_ll_set_duty_int_part(ledc, LEDC_LOW_SPEED_MODE, motor->channel, duty);
+    ledc_ll_set_duty_start(ledc, LEDC_LOW_SPEED_MODE, motor->channel, true);
+    ledc_ll_ls_channel_update(ledc, LEDC_LOW_SPEED_MODE, motor->channel);
+    motor->duty = duty;
+}
+
+// Reversal dead time is kept by time stamps: the bridge stays off until
+// dead_time_us after it was switched off, the caller just keeps calling at
+// its control rate. duty is in LEDC counts.
+static inline esp_err_t IRAM_ATTR motor_apply_hw(struct motor_dev_t *motor, uint32_t duty, motor_dir_t dir)
+{
+    if (motor->dead_time_us && dir != motor->dir) {
+        int64_t now = esp_timer_get_time();
+        if (motor->dir != MOTOR_DIR_COAST) {
+            // Going off (or reversing): coast now, new direction later
+            dir = MOTOR_DIR_COAST;
+            duty = 0;
+            motor->off_us = now;
+        } else if (now - motor->off_us < motor->dead_time_us) {
+            return ESP_OK;
+        }
+    }
+    // Kept for the thermal model to restore once it cools
+    motor->target = duty;
+    motor->direct = true;
+    uint32_t limit = motor_duty_limit(motor);
+    if (duty > limit) duty = limit;
+    if (duty != motor->duty) motor_ll_write_duty(motor, duty);
+    if (dir != motor->dir) motor_write_pins(motor, dir);
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR motor_apply(motor_handle_t motor, uint32_t duty, motor_dir_t dir)
+{
+    return motor_apply_hw(motor, motor_hw_duty(motor, duty), dir);
+}
+
+// The LEDC resolution falls as the PWM frequency rises (C3, 80 MHz source:
+// 11 bit at 20 kHz). Dithering across updates restores the Q16 request on
+// average; the motor's electrical and mechanical time constants do the
+// averaging.
+esp_err_t IRAM_ATTR motor_apply_q16(motor_handle_t motor, uint32_t duty_q16, motor_dir_t dir)
+{
+    return motor_apply_hw(motor, motor_dither_step(&motor->dither, duty_q16, motor->duty_bits), dir);
+}
+
+// Torque command to Q16 duty through the table. The interpolation stays in
+// 32 bits: point differences are at most 2^16, fractions below 2^15.
+static inline uint32_t IRAM_ATTR motor_torque_duty(const struct motor_dev_t *motor, int32_t torque, motor_dir_t *dir)
+{
+    *dir = torque < 0 ? MOTOR_DIR_BACKWARD : MOTOR_DIR_FORWARD;
+    // Raw controller output: negated unsigned, INT32_MIN included
+    uint32_t mag = torque < 0 ? 0u - (uint32_t)torque : (uint32_t)torque;
+    if (mag > MOTOR_TORQUE_FULL_Q15) mag = MOTOR_TORQUE_FULL_Q15;
+    if (!motor->comp_on || mag == 0) return mag << 1;
+
+    const uint32_t *pts = torque < 0 ? motor->comp.bwd : motor->comp.fwd;
+    if (mag == MOTOR_TORQUE_FULL_Q15) return pts[MOTOR_COMP_POINTS - 1];
+    uint32_t pos = mag * (MOTOR_COMP_POINTS - 1);
+    uint32_t i = pos >> 15;
+    int32_t frac = pos & 0x7FFF;
+    int32_t a = pts[i], b = pts[i + 1];
+    return a + (((b - a) * frac) >> 15);
+}
+
+esp_err_t motor_set_comp_table(motor_handle_t motor, const motor_comp_table_t *table)
+{
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    if (!table) {
+        motor->comp_on = false;
+        return ESP_OK;
+    }
+    for (int i = 0; i < MOTOR_COMP_POINTS; i++) {
+        if (table->fwd[i] > MOTOR_DUTY_FULL_Q16 || table->bwd[i] > MOTOR_DUTY_FULL_Q16) return ESP_ERR_INVALID_ARG;
+        if (i && (table->fwd[i] < table->fwd[i - 1] || table->bwd[i] < table->bwd[i - 1])) return ESP_ERR_INVALID_ARG;
+    }
+    // Not atomic against motor_apply_torque: install before the control loop runs
+    motor->comp = *table;
+    motor->comp_on = true;
     return ESP_OK;
 }
 
-esp_err_t motor_stop(void)
+esp_err_t motor_set_torque(motor_handle_t motor, int32_t torque_q15)
+{
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    motor_dir_t dir;
+    uint32_t q16 = motor_torque_duty(motor, torque_q15, &dir);
+    motor_lock(motor);
+    esp_err_t ret = ESP_OK;
+    if (q16 != 0) ret = motor_change_dir(motor, dir);
+    if (ret == ESP_OK) ret = motor_set_target(motor, motor_rescale(q16, 16, motor->duty_bits));
+    motor_unlock(motor);
+    return ret;
+}
+
+// Zero torque keeps the direction pins: no dead time around every zero crossing of the command
+esp_err_t IRAM_ATTR motor_apply_torque(motor_handle_t motor, int32_t torque_q15)
+{
+    motor_dir_t dir;
+    uint32_t q16 = motor_torque_duty(motor, torque_q15, &dir);
+    if (q16 == 0) dir = (motor_dir_t)motor->dir;
+    return motor_apply_hw(motor, motor_dither_step(&motor->dither, q16, motor->duty_bits), dir);
+}
+
+// The timer's divider and resolution and every channel's duty go through
+// shadow registers latched at the timer overflow. All of them are written
+// back to back with interrupts off, so they land on the same period
+// boundary: no period runs the old duty on the new scale or the reverse.
+esp_err_t motor_set_pwm_profile(motor_handle_t motor, uint32_t freq_hz)
+{
+    if (!motor || freq_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t src_hz = 0;
+    esp_err_t ret = esp_clk_tree_src_get_freq_hz(SOC_MOD_CLK_APB, ESP_CLK_TREE_SRC_FREQ_PRECISION_CACHED, &src_hz);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    uint32_t bits = ledc_find_suitable_duty_resolution(src_hz, freq_hz);
+    if (bits == 0)
+    {
+        ESP_LOGE(TAG, "%lu Hz is out of the LEDC range", (unsigned long)freq_hz);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // 10.8 fixed point, rounded as ledc_timer_config does
+    uint64_t period = (uint64_t)freq_hz << bits;
+    uint64_t div = (((uint64_t)src_hz << LEDC_LL_FRACTIONAL_BITS) + period / 2) / period;
+    if (div < MOTOR_LEDC_DIV_MIN || div > MOTOR_LEDC_DIV_MAX)
+    {
+        // The resolution tops out at 14 bit: too low a frequency needs more
+        // divider than the register field holds
+        ESP_LOGE(TAG, "%lu Hz: divider out of range", (unsigned long)freq_hz);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    motor_timer_t *t = &s_timers[motor->timer];
+    if (t->freq_hz == freq_hz && t->duty_resolution == bits)
+    {
+        return ESP_OK;
+    }
+
+    // Every axis on this timer switches with it, each held under its lock
+    // (taken in channel order). Ramps are stopped where they are and
+    // restarted towards their rescaled target afterwards.
+    uint32_t final[LEDC_CHANNEL_MAX] = { 0 };
+    bool was_ramping[LEDC_CHANNEL_MAX] = { 0 };
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++)
+    {
+        struct motor_dev_t *m = s_motors[ch];
+        if (!m || m->timer != motor->timer)
+        {
+            continue;
+        }
+        motor_lock(m);
+        final[ch] = m->duty;
+        was_ramping[ch] = m->ramping;
+        if (m->ramping)
+        {
+            ledc_fade_stop(LEDC_LOW_SPEED_MODE, m->channel);
+            m->ramping = false;
+            m->duty = ledc_get_duty(LEDC_LOW_SPEED_MODE, m->channel);
+        }
+    }
+
+    ledc_dev_t *ledc = LEDC_LL_GET_HW();
+    portENTER_CRITICAL(&s_ledc_lock);
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++)
+    {
+        struct motor_dev_t *m = s_motors[ch];
+        if (!m || m->timer != motor->timer)
+        {
+            continue;
+        }
+        uint32_t old_bits = m->duty_bits;
+        m->duty_bits = bits;
+        m->duty_max = (1u << bits) - 1;
+        m->dither.err = 0;
+        m->target = motor_rescale(m->target, old_bits, bits);
+        final[ch] = motor_rescale(final[ch], old_bits, bits);
+        motor_ll_write_duty(m, m->dir == MOTOR_DIR_BRAKE ? m->duty_max : motor_rescale(m->duty, old_bits, bits));
+    }
+    ledc_ll_set_clock_divider(ledc, LEDC_LOW_SPEED_MODE, motor->timer, (uint32_t)div);
+    ledc_ll_set_duty_resolution(ledc, LEDC_LOW_SPEED_MODE, motor->timer, bits);
+    ledc_ll_ls_timer_update(ledc, LEDC_LOW_SPEED_MODE, motor->timer);
+    portEXIT_CRITICAL(&s_ledc_lock);
+
+    t->freq_hz = freq_hz;
+    t->duty_resolution = bits;
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++)
+    {
+        struct motor_dev_t *m = s_motors[ch];
+        if (!m || m->timer != motor->timer)
+        {
+            continue;
+        }
+        if (was_ramping[ch])
+        {
+            motor_drive_duty(m, final[ch]);
+        }
+        motor_unlock(m);
+    }
+    ESP_LOGI(TAG, "timer %d: %lu Hz, %lu bit", motor->timer, (unsigned long)freq_hz, (unsigned long)bits);
+
+    // Current sampling is locked to the PWM frequency
+    return motor_priv_current_retune();
+}
+
+// Heat input: (I / I_rated)^2, I from the measured current or the duty
+static uint32_t motor_thermal_load_q16(struct motor_dev_t *motor)
+{
+    int32_t ma;
+    if (motor->thermal.rated_ma && motor_get_current(motor, &ma, NULL) == ESP_OK) {
+        return (uint32_t)((uint64_t)(ma < 0 ? -ma : ma) * MOTOR_DUTY_FULL_Q16 / motor->thermal.rated_ma);
+    }
+    if (motor->dir != MOTOR_DIR_FORWARD && motor->dir != MOTOR_DIR_BACKWARD) return 0;
+    uint32_t duty = motor->ramping ? ledc_get_duty(LEDC_LOW_SPEED_MODE, motor->channel) : motor->duty;
+    uint32_t q16 = motor_rescale(duty, motor->duty_bits, 16);
+    return (uint32_t)((uint64_t)q16 * MOTOR_DUTY_FULL_Q16 / motor->thermal.rated_q16);
+}
+
+// esp_timer, every MOTOR_THERMAL_TICK_MS: first-order model
+// heat += (load^2 - heat) * dt / tau, kept in Q32 so that slow time
+// constants still converge, then the foldback limit. A duty above the
+// new limit is cut here, and a clamped one restored as the limit rises:
+// the control task may not command again soon. Both go through the path
+// that set the target, under that path's lock. The whole tick holds the
+// motor lock, see motor_delete.
+static void motor_thermal_tick(void *arg)
+{
+    struct motor_dev_t *motor = (struct motor_dev_t *)arg;
+    const motor_thermal_config_t *cfg = &motor->thermal;
+
+    motor_lock(motor);
+    if (motor->deleting) {
+        motor_unlock(motor);
+        return;
+    }
+    uint64_t load = motor_thermal_load_q16(motor);
+    if (load > (16u << 16)) load = 16u << 16;
+    int64_t in_q32 = (int64_t)(load * load);
+    motor->heat_q32 += (in_q32 - motor->heat_q32) * MOTOR_THERMAL_TICK_MS / (int64_t)cfg->tau_ms;
+
+    uint32_t heat = (uint32_t)(motor->heat_q32 >> 16);
+    uint32_t start = cfg->foldback_pct * MOTOR_DUTY_FULL_Q16 / 100;
+    uint32_t limit;
+    if (heat <= start) {
+        limit = MOTOR_DUTY_FULL_Q16;
+    } else if (heat < MOTOR_DUTY_FULL_Q16) {
+        uint32_t span = MOTOR_DUTY_FULL_Q16 - cfg->rated_q16;
+        limit = MOTOR_DUTY_FULL_Q16 - (uint32_t)((uint64_t)span * (heat - start) / (MOTOR_DUTY_FULL_Q16 - start));
+    } else {
+        // Past the rating: load^2 at this limit is below the heat, it cools
+        limit = (uint32_t)((uint64_t)cfg->rated_q16 * MOTOR_DUTY_FULL_Q16 / heat);
+    }
+    motor->limit_q16 = limit;
+
+    if (motor->direct) {
+        // Against motor_apply from an ISR: decide and write in one go
+        portENTER_CRITICAL(&s_ledc_lock);
+        if (motor->dir == MOTOR_DIR_FORWARD || motor->dir == MOTOR_DIR_BACKWARD) {
+            uint32_t hw_limit = motor_duty_limit(motor);
+            uint32_t want = motor->target > hw_limit ? hw_limit : motor->target;
+            if (motor->duty > hw_limit || (motor->thermal_clamped && motor->duty != want)) {
+                motor_ll_write_duty(motor, want);
+            }
+            motor->thermal_clamped = motor->target > hw_limit;
+        }
+        portEXIT_CRITICAL(&s_ledc_lock);
+    } else if (!motor->in_deadtime && (motor->dir == MOTOR_DIR_FORWARD || motor->dir == MOTOR_DIR_BACKWARD)) {
+        // Driver path: motor_drive_duty clamps to the limit and ramps when
+        // max_slope is set, like motor_set_speed
+        uint32_t hw_limit = motor_duty_limit(motor);
+        uint32_t want = motor->target > hw_limit ? hw_limit : motor->target;
+        if (motor->duty > hw_limit || (motor->thermal_clamped && motor->duty != want)) {
+            motor_drive_duty(motor, motor->target);
+        }
+        motor->thermal_clamped = motor->target > hw_limit;
+    }
+    motor_unlock(motor);
+}
+
+esp_err_t motor_thermal_enable(motor_handle_t motor, const motor_thermal_config_t *cfg)
+{
+    if (!motor || !cfg || cfg->tau_ms < MOTOR_THERMAL_TICK_MS || cfg->rated_q16 == 0 ||
+        cfg->rated_q16 > MOTOR_DUTY_FULL_Q16 || cfg->foldback_pct >= 100)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (motor->thermal_timer)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    motor->thermal = *cfg;
+    if (!motor->thermal.foldback_pct)
+    {
+        motor->thermal.foldback_pct = 70;
+    }
+    motor->heat_q32 = 0;
+    motor->limit_q16 = MOTOR_DUTY_FULL_Q16;
+
+    esp_timer_create_args_t targs = {
+        .callback = motor_thermal_tick,
+        .arg = motor,
+        .name = "motor_i2t",
+    };
+    esp_err_t ret = esp_timer_create(&targs, &motor->thermal_timer);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = esp_timer_start_periodic(motor->thermal_timer, MOTOR_THERMAL_TICK_MS * 1000);
+    if (ret != ESP_OK)
+    {
+        esp_timer_delete(motor->thermal_timer);
+        motor->thermal_timer = NULL;
+    }
+    return ret;
+}
+
+esp_err_t motor_get_thermal(motor_handle_t motor, uint32_t *heat_pct, uint32_t *limit_q16)
 {
-    // Set duty cycle to 0 to stop the motor
-    gpio_set_level(motor.forward_pin, 0);
-    gpio_set_level(motor.backward_pin, 0);
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    if (!motor) return ESP_ERR_INVALID_ARG;
+    if (heat_pct) *heat_pct = (uint32_t)((motor->heat_q32 * 100) >> 32);
+    if (limit_q16) *limit_q16 = motor->limit_q16;
     return ESP_OK;
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+// Temporal duty dithering, plain C so the host model (host/dither_model.c)
+// runs exactly the code the driver runs.
+//
+// The requested duty is a Q16 fraction of full scale. Each update emits the
+// integer LEDC duty and carries the remainder to the next one (first-order
+// error feedback), so the output averages to the Q16 request: over any N
+// updates the mean is within one LEDC count / N of it.
+
+#define MOTOR_DITHER_ONE    (1u << 16)      // 100 % duty in Q16
+
+typedef struct
+{
+    uint32_t err;           // carried remainder, Q16 of one LEDC count
+} motor_dither_t;
+
+// duty_q16: 0 .. MOTOR_DITHER_ONE, bits: LEDC duty resolution (<= 14).
+// Returns 0 .. 2^bits (2^bits = output always on). Always inlined: it runs
+// inside the IRAM apply paths, and this header has no esp_attr.h for the host.
+static inline __attribute__((always_inline)) uint32_t motor_dither_step(motor_dither_t *d, uint32_t duty_q16, uint32_t bits)
+{
+    if (duty_q16 > MOTOR_DITHER_ONE)
+    {
+        duty_q16 = MOTOR_DITHER_ONE;
+    }
+    uint32_t want = (duty_q16 << bits) + d->err;
+    d->err = want & 0xFFFF;
+    return want >> 16;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "motor_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared between the source files of this component only.
+
+// PWM frequency of the LEDC timer driving this motor
+uint32_t motor_priv_pwm_freq(motor_handle_t motor);
+// Called by motor_delete: drop the motor from current sensing
+void     motor_priv_current_detach(motor_handle_t motor);
+// Called after a PWM frequency change: restart sampling on the new frequency
+esp_err_t motor_priv_current_retune(void);
+
+#ifdef __cplusplus
+}
+#endif
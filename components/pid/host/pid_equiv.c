@@ -0,0 +1,134 @@
+// Host equivalence test: fixed-point PID kernel against the float reference
+//
+// Runs pid_q_step and pid_f32_step (the headers the target builds) side by
+// side over error sequences that exercise each term, the clamps and int32
+// extremes, and checks the Q16 output stays within tolerance of the float
+// one. The float reference is itself only float-accurate, the tolerance
+// covers both roundings.
+//
+// Build (from components/pid):
+//   cc -O2 -Wall -I../encoder_driver/host/mock -Iinclude pid.c host/pid_equiv.c -o /tmp/pid_equiv -lm
+//
+// Run:
+//   /tmp/pid_equiv                 default suite, non-zero exit on regression
+//   /tmp/pid_equiv --verbose       per-scenario worst step
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid.h"
+
+#define STEPS   20000
+
+typedef int32_t (*error_fn_t)(uint32_t k);
+
+static int32_t _step(uint32_t k)     { return k < 10 ? 0 : 40; }
+static int32_t _small(uint32_t k)    { return (int32_t)(k % 7) - 3; }
+static int32_t _ramp(uint32_t k)     { return (int32_t)(k % 2000) - 1000; }
+static int32_t _hold_one(uint32_t k) { return k & 1; }              // limit cycle around one count
+static int32_t _windup(uint32_t k)   { return k < STEPS / 2 ? 90 : -90; }
+static int32_t _extreme(uint32_t k)  { return (k & 1) ? INT32_MAX : INT32_MIN; }
+static int32_t _noise(uint32_t k) {
+    static uint32_t x = 12345;
+    if (k == 0) x = 12345;
+    x = x * 1103515245u + 12345u;
+    return (int32_t)((x >> 16) % 201) - 100;
+}
+
+typedef struct {
+    const char* name;
+    error_fn_t fn;
+} sequence_t;
+
+static const sequence_t s_sequences[] = {
+    { "step",     _step },
+    { "small",    _small },
+    { "ramp",     _ramp },
+    { "hold one", _hold_one },
+    { "windup",   _windup },
+    { "extreme",  _extreme },
+    { "noise",    _noise },
+};
+
+typedef struct {
+    const char* name;
+    pid_config_t cfg;
+} config_case_t;
+
+static const config_case_t s_configs[] = {
+    // The app's position loop at 1 kHz and 10 kHz
+    { "app 1 kHz",    { 15.0f, 0.5f, 0.5f, 0.001f,  0.01f, 1023.0f } },
+    { "app 10 kHz",   { 15.0f, 0.5f, 0.5f, 0.0001f, 0.01f, 1023.0f } },
+    { "unfiltered D", { 2.0f,  20.0f, 0.01f, 0.002f, 0.0f, 1023.0f } },
+    { "PI only",      { 0.8f,  3.0f, 0.0f, 0.0005f, 0.0f, 100.0f } },
+    { "full range",   { 300.0f, 50.0f, 0.2f, 0.001f, 0.002f, 32767.0f } },
+};
+
+// Absolute tolerance in output units, relative to the clamp
+static double _tolerance(const pid_config_t* cfg) {
+    return 1e-4 * cfg->out_limit + 2.0 / 65536.0;
+}
+
+static int _run(const config_case_t* c, const sequence_t* seq, bool verbose) {
+    pid_f32_t f;
+    pid_q_t q;
+    if (pid_f32_init(&f, &c->cfg) != ESP_OK || pid_q_init(&q, &c->cfg) != ESP_OK) {
+        printf("%-12s %-9s init failed\n", c->name, seq->name);
+        return 1;
+    }
+    double worst = 0;
+    uint32_t worst_k = 0;
+    for (uint32_t k = 0; k < STEPS; k++) {
+        int32_t e = seq->fn(k);
+        double of = pid_f32_step(&f, e);
+        double oq = pid_q_step(&q, e) / 65536.0;
+        double d = fabs(of - oq);
+        if (d > worst) {
+            worst = d;
+            worst_k = k;
+        }
+    }
+    double tol = _tolerance(&c->cfg);
+    bool ok = worst <= tol;
+    if (verbose || !ok) {
+        printf("%-12s %-9s max diff %.6f at step %u (tolerance %.6f)  %s\n",
+               c->name, seq->name, worst, worst_k, tol, ok ? "ok" : "FAIL");
+    }
+    return ok ? 0 : 1;
+}
+
+// Gains that do not fit their Q format must be refused, not wrapped
+static int _rejects(void) {
+    const pid_config_t bad[] = {
+        { 40000.0f, 0, 0, 0.001f, 0, 1023.0f },     // kp beyond Q16
+        { 1.0f, 0, 50.0f, 0.0001f, 0, 1023.0f },    // kd / dt beyond Q16
+        { 1.0f, 1.0f, 0, 0.001f, 0, 40000.0f },     // output beyond the Q16 range
+        { 1.0f, 1.0f, 0, 0.0f, 0, 1023.0f },        // no dt
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        pid_q_t q;
+        if (pid_q_init(&q, &bad[i]) != ESP_ERR_INVALID_ARG) {
+            printf("config %zu accepted\n", i);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = argc > 1 && !strcmp(argv[1], "--verbose");
+    if (argc > 1 && !verbose) {
+        fprintf(stderr, "usage: %s [--verbose]\n", argv[0]);
+        return 2;
+    }
+    int failed = _rejects();
+    for (size_t c = 0; c < sizeof(s_configs) / sizeof(s_configs[0]); c++) {
+        for (size_t s = 0; s < sizeof(s_sequences) / sizeof(s_sequences[0]); s++) {
+            failed += _run(&s_configs[c], &s_sequences[s], verbose);
+        }
+    }
+    printf("%s\n", failed ? "REGRESSION" : "fixed-point PID matches the float reference");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Position PID with a fixed dt, in two builds of the same algorithm:
+//
+//   p = kp * e
+//   i += ki * dt * e                       clamped to +-out_limit (anti-windup)
+//   d_raw = kd / dt * (e - e_prev)         clamped to +-2 * out_limit
+//   d += (d_raw - d) * dt / (d_tau + dt)   first-order filter
+//   out = clamp(p + i + d, +-out_limit)
+//
+// pid_f32_*: float reference. pid_q_*: integer only, for the FPU-less C3
+// (soft-float costs a library call per operation). Both are set up from
+// the same float pid_config_t, once, outside the loop.
+//
+// Fixed point: gains kp and kd/dt in Q16, ki*dt in Q32, the filter weight
+// in Q30, the output in Q16 (output units * 65536). Products are 32x32->64,
+// sums are 64 bit and saturate into the clamps, so no input can overflow:
+// any int32 error is valid.
+
+typedef struct {
+    float kp;                   // output per unit of error
+    float ki;                   // per second
+    float kd;                   // seconds
+    float dt;                   // control period, seconds
+    float d_tau;                // derivative filter time constant, seconds, 0 = unfiltered
+    float out_limit;            // output clamp, +-; at most 32767
+} pid_config_t;
+
+typedef struct {
+    float kp, ki_dt, kd_dt, alpha, limit;
+    float i, d;
+    int32_t e_prev;
+    bool primed;
+} pid_f32_t;
+
+typedef struct {
+    int32_t kp_q16;
+    int32_t ki_dt_q32;
+    int32_t kd_dt_q16;
+    int32_t alpha_q30;
+    int32_t limit_q16;
+    int64_t i_q32;              // integral term, output units in Q32
+    int64_t d_q16;              // filtered derivative term, up to 2 * limit
+    int32_t e_prev;
+    bool primed;
+} pid_q_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t pid_f32_init(pid_f32_t* pid, const pid_config_t* cfg);
+void      pid_f32_reset(pid_f32_t* pid);
+float     pid_f32_step(pid_f32_t* pid, int32_t error);
+
+// ESP_ERR_INVALID_ARG if a gain does not fit its Q format
+esp_err_t pid_q_init(pid_q_t* pid, const pid_config_t* cfg);
+void      pid_q_reset(pid_q_t* pid);
+int32_t   pid_q_step(pid_q_t* pid, int32_t error);      // Q16
+
+// On target: time both kernels (CPU cycles per step) over a fixed error
+// sequence and log them with the largest output difference.
+void      pid_benchmark(const pid_config_t* cfg, uint32_t steps);
+
+#ifdef __cplusplus
+}
+#endif
+
+// Kernels inline: the control step calls them from its own hot path
+
+static inline int64_t _pid_clamp64(int64_t v, int64_t lim) {
+    return v > lim ? lim : (v < -lim ? -lim : v);
+}
+
+static inline float _pid_clampf(float v, float lim) {
+    return v > lim ? lim : (v < -lim ? -lim : v);
+}
+
+static inline float pid_f32_step_inline(pid_f32_t* pid, int32_t error) {
+    if (!pid->primed) {
+        pid->e_prev = error;
+        pid->primed = true;
+    }
+    float p = pid->kp * (float)error;
+    pid->i = _pid_clampf(pid->i + pid->ki_dt * (float)error, pid->limit);
+    float d_raw = _pid_clampf(pid->kd_dt * (float)((int64_t)error - pid->e_prev), 2.0f * pid->limit);
+    pid->d += (d_raw - pid->d) * pid->alpha;
+    pid->e_prev = error;
+    return _pid_clampf(p + pid->i + pid->d, pid->limit);
+}
+
+static inline int32_t pid_q_step_inline(pid_q_t* pid, int32_t error) {
+    if (!pid->primed) {
+        pid->e_prev = error;
+        pid->primed = true;
+    }
+    int64_t p = (int64_t)error * pid->kp_q16;
+    // |i| <= limit, one step adds < 2^63 - 2^47: the sum cannot wrap
+    pid->i_q32 = _pid_clamp64(pid->i_q32 + (int64_t)error * pid->ki_dt_q32, (int64_t)pid->limit_q16 << 16);
+    // The difference needs 33 bits, its product is clamped to 2 * limit < 2^32
+    int64_t d_raw = _pid_clamp64(((int64_t)error - pid->e_prev) * pid->kd_dt_q16, 2 * (int64_t)pid->limit_q16);
+    // |d_raw - d| < 2^33, alpha <= 2^30: the product stays below 2^63
+    pid->d_q16 += ((d_raw - pid->d_q16) * pid->alpha_q30) >> 30;
+    pid->e_prev = error;
+    return (int32_t)_pid_clamp64(p + (pid->i_q32 >> 16) + pid->d_q16, pid->limit_q16);
+}
@@ -0,0 +1,65 @@
+#include <math.h>
+#include <string.h>
+
+#include "pid.h"
+
+static bool _pid_config_ok(const pid_config_t* cfg) {
+    return cfg && cfg->dt > 0.0f && cfg->d_tau >= 0.0f && cfg->out_limit > 0.0f && cfg->out_limit <= 32767.0f;
+}
+
+static float _pid_alpha(const pid_config_t* cfg) {
+    return cfg->dt / (cfg->d_tau + cfg->dt);
+}
+
+esp_err_t pid_f32_init(pid_f32_t* pid, const pid_config_t* cfg) {
+    if (!pid || !_pid_config_ok(cfg)) return ESP_ERR_INVALID_ARG;
+    memset(pid, 0, sizeof(*pid));
+    pid->kp    = cfg->kp;
+    pid->ki_dt = cfg->ki * cfg->dt;
+    pid->kd_dt = cfg->kd / cfg->dt;
+    pid->alpha = _pid_alpha(cfg);
+    pid->limit = cfg->out_limit;
+    return ESP_OK;
+}
+
+void pid_f32_reset(pid_f32_t* pid) {
+    pid->i = 0.0f;
+    pid->d = 0.0f;
+    pid->primed = false;
+}
+
+float pid_f32_step(pid_f32_t* pid, int32_t error) {
+    return pid_f32_step_inline(pid, error);
+}
+
+// Rounded to Q<shift>, false if it does not fit an int32
+static bool _pid_to_q(double v, int shift, int32_t* out) {
+    double q = round(v * (double)(1LL << shift));
+    if (q > (double)INT32_MAX || q < (double)INT32_MIN) return false;
+    *out = (int32_t)q;
+    return true;
+}
+
+esp_err_t pid_q_init(pid_q_t* pid, const pid_config_t* cfg) {
+    if (!pid || !_pid_config_ok(cfg)) return ESP_ERR_INVALID_ARG;
+    pid_q_t q = { 0 };
+    if (!_pid_to_q(cfg->kp, 16, &q.kp_q16) ||
+        !_pid_to_q((double)cfg->ki * cfg->dt, 32, &q.ki_dt_q32) ||
+        !_pid_to_q((double)cfg->kd / cfg->dt, 16, &q.kd_dt_q16) ||
+        !_pid_to_q(_pid_alpha(cfg), 30, &q.alpha_q30) ||
+        !_pid_to_q(cfg->out_limit, 16, &q.limit_q16)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *pid = q;
+    return ESP_OK;
+}
+
+void pid_q_reset(pid_q_t* pid) {
+    pid->i_q32 = 0;
+    pid->d_q16 = 0;
+    pid->primed = false;
+}
+
+int32_t pid_q_step(pid_q_t* pid, int32_t error) {
+    return pid_q_step_inline(pid, error);
+}
@@ -0,0 +1,51 @@
+#include <math.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+
+#include "pid.h"
+
+#define TAG "pid_bench"
+
+// Step, hold, slow sine-like swing and a sign flip: exercises every term and the clamps
+static int32_t _bench_error(uint32_t k) {
+    uint32_t phase = k & 1023;
+    if (phase < 256) return 200;
+    if (phase < 512) return (int32_t)(phase & 31) - 16;
+    if (phase < 768) return (int32_t)(phase - 640);
+    return -3;
+}
+
+void pid_benchmark(const pid_config_t* cfg, uint32_t steps) {
+    pid_f32_t f;
+    pid_q_t q;
+    if (pid_f32_init(&f, cfg) != ESP_OK || pid_q_init(&q, cfg) != ESP_OK || steps == 0) {
+        ESP_LOGE(TAG, "bad config");
+        return;
+    }
+
+    // Separate passes so each loop keeps its own code in the cache
+    volatile float f_sink = 0;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (uint32_t k = 0; k < steps; k++) f_sink = pid_f32_step_inline(&f, _bench_error(k));
+    uint32_t f_cycles = esp_cpu_get_cycle_count() - start;
+
+    volatile int32_t q_sink = 0;
+    start = esp_cpu_get_cycle_count();
+    for (uint32_t k = 0; k < steps; k++) q_sink = pid_q_step_inline(&q, _bench_error(k));
+    uint32_t q_cycles = esp_cpu_get_cycle_count() - start;
+
+    // Same inputs again, in lockstep, for the output difference
+    pid_f32_reset(&f);
+    pid_q_reset(&q);
+    float diff_max = 0;
+    for (uint32_t k = 0; k < steps; k++) {
+        int32_t e = _bench_error(k);
+        float diff = fabsf(pid_f32_step_inline(&f, e) - pid_q_step_inline(&q, e) / 65536.0f);
+        if (diff > diff_max) diff_max = diff;
+    }
+    (void)f_sink;
+    (void)q_sink;
+    ESP_LOGI(TAG, "%lu steps: float %lu cycles/step, fixed %lu cycles/step, max diff %.4f",
+             (unsigned long)steps, (unsigned long)(f_cycles / steps), (unsigned long)(q_cycles / steps), diff_max);
+}
@@ -4,12 +4,15 @@
 #include "app_driver.h"
 #include "motor_driver.h"
 #include "encoder_driver.h"
+#include "homing.h"
+#include "control_loop.h"
 
 #include "ssd1306.h"
 #include "fonts.h"
 
 #define TAG "app_driver"
 
+static motor_handle_t s_motor = NULL;
 static ky040_handle_t s_enc1 = NULL;
 static ky040_handle_t s_enc2 = NULL;
 
@@ -20,13 +23,61 @@ void app_driver_init(void)
         .pwm_pin = MOTOR_PWM_PIN,           // PWM output pin
         .forward_pin = MOTOR_FORWARD_PIN,   // Forward direction control pin
         .backward_pin = MOTOR_BACKWARD_PIN, // Backward direction control pin
+        .channel = MOTOR_LEDC_CHANNEL,
+        .timer = MOTOR_LEDC_TIMER,
+        .max_slope = MOTOR_MAX_SLOPE,
+        .dead_time_us = MOTOR_DEAD_TIME_US,
+        .dedic_gpio = MOTOR_DEDIC_GPIO,
     };
 
-    motor_driver_init(&motor_config);
+    ESP_ERROR_CHECK(motor_create(&motor_config, &s_motor));
+    ESP_ERROR_CHECK(motor_set_pwm_profile(s_motor, MOTOR_PWM_FREQ_HZ));
+    motor_comp_table_t comp;
+    motor_comp_linear(&comp, MOTOR_BREAKAWAY_FWD_PCT * MOTOR_DUTY_FULL_Q16 / 100,
+                      MOTOR_BREAKAWAY_BWD_PCT * MOTOR_DUTY_FULL_Q16 / 100);
+    ESP_ERROR_CHECK(motor_set_comp_table(s_motor, &comp));
+#if MOTOR_THERMAL_TAU_MS
+    motor_thermal_config_t thermal_config = {
+        .tau_ms = MOTOR_THERMAL_TAU_MS,
+        .rated_q16 = MOTOR_RATED_PCT * MOTOR_DUTY_FULL_Q16 / 100,
+        .rated_ma = MOTOR_CURRENT_SENSE ? MOTOR_RATED_MA : 0,
+    };
+    ESP_ERROR_CHECK(motor_thermal_enable(s_motor, &thermal_config));
+#endif
+#if MOTOR_CURRENT_SENSE
+    motor_current_config_t sense_config = {
+        .pin = MOTOR_SENSE_PIN,
+        .atten = ADC_ATTEN_DB_12,
+        .mv_per_amp = MOTOR_SENSE_MV_PER_A,
+        .offset_mv = MOTOR_SENSE_OFFSET_MV,
+        .filter_shift = 3,
+    };
+    ESP_ERROR_CHECK(motor_current_attach(s_motor, &sense_config));
+    ESP_ERROR_CHECK(motor_current_start(MOTOR_SENSE_PER_PERIOD));
+#endif
 
+#if ENCODER_BATCHED_ISR
+    ESP_ERROR_CHECK(ky040_install_batched_isr(0));
+#else
     ESP_ERROR_CHECK(ky040_install_isr_service_once(0));
-    ky040_config_t c1 = {ENC1_CLK_GPIO, ENC1_DT_GPIO, ENC1_SW_GPIO, ENC1_REVERSE_DIR, ENCODER_DEBOUNCE_US, ANGLE_MIN, ANGLE_MAX};
-    ky040_config_t c2 = {ENC2_CLK_GPIO, ENC2_DT_GPIO, ENC2_SW_GPIO, ENC2_REVERSE_DIR, ENCODER_DEBOUNCE_US, ANGLE_MIN, ANGLE_MAX};
+#endif
+    ky040_config_t c1 = {
+        .gpio_clk = ENC1_CLK_GPIO, .gpio_dt = ENC1_DT_GPIO, .gpio_sw = ENC1_SW_GPIO,
+        .reverse_dir = ENC1_REVERSE_DIR,
+        .debounce_us = ENCODER_DEBOUNCE_US,
+        .debounce_min_us = ENCODER_DEBOUNCE_MIN_US, .debounce_max_us = ENCODER_DEBOUNCE_ADAPTIVE ? ENCODER_DEBOUNCE_US : 0,
+        .angle_min = ANGLE_MIN, .angle_max = ANGLE_MAX,
+        .decode = ENC1_DECODE_MODE, .filter = ENCODER_FILTER,
+    };
+    ky040_config_t c2 = {
+        .gpio_clk = ENC2_CLK_GPIO, .gpio_dt = ENC2_DT_GPIO, .gpio_sw = ENC2_SW_GPIO,
+        .reverse_dir = ENC2_REVERSE_DIR,
+        .debounce_us = ENCODER_DEBOUNCE_US,
+        .debounce_min_us = ENCODER_DEBOUNCE_MIN_US, .debounce_max_us = ENCODER_DEBOUNCE_ADAPTIVE ? ENCODER_DEBOUNCE_US : 0,
+        .angle_min = ANGLE_MIN, .angle_max = ANGLE_MAX,
+        .decode = ENC2_DECODE_MODE, .filter = ENCODER_FILTER,
+        .sw_mode = HOMING_ENABLE ? KY040_SW_INDEX : KY040_SW_ZERO,
+    };
     ESP_ERROR_CHECK(ky040_create(&c1, &s_enc1));
     ESP_ERROR_CHECK(ky040_create(&c2, &s_enc2));
 
@@ -51,16 +102,78 @@ void app_driver_init(void)
 
 esp_err_t app_driver_motor_set_speed(uint8_t speed)
 {
-    return motor_set_speed(speed);
+    return motor_set_speed(s_motor, speed);
 }
 esp_err_t app_driver_motor_set_direction(bool direction)
 {
-    return motor_set_direction(direction);
+    return motor_set_direction(s_motor, direction);
 }
 
 esp_err_t app_driver_motor_stop(void)
 {
-    return motor_stop();
+#if MOTOR_STOP_BRAKE
+    return motor_brake(s_motor);
+#else
+    return motor_stop(s_motor);
+#endif
+}
+
+esp_err_t app_driver_motor_set_torque(int32_t torque)
+{
+    return motor_set_torque(s_motor, torque);
+}
+
+esp_err_t app_driver_motor_apply_torque(int32_t torque)
+{
+    return motor_apply_torque(s_motor, torque);
+}
+
+static int64_t app_driver_read_feedback(void *ctx)
+{
+    return ky040_get_position(s_enc2);
+}
+
+esp_err_t app_driver_motor_calibrate(void)
+{
+    motor_calib_config_t cfg = {
+        .read_position = app_driver_read_feedback,
+    };
+    return motor_calibrate(s_motor, &cfg, NULL);
+}
+
+esp_err_t app_driver_motor_set_pwm(uint32_t freq_hz)
+{
+    // motor_apply_torque in the loop reads the resolution without a lock
+    if (control_loop_running())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return motor_set_pwm_profile(s_motor, freq_hz);
+}
+
+static esp_err_t app_driver_home_drive(int dir, uint32_t speed, void *ctx)
+{
+    if (speed == 0)
+    {
+        return motor_stop(s_motor);
+    }
+    motor_set_direction(s_motor, (dir > 0) == HOME_DIR_FORWARD);
+    return motor_set_speed(s_motor, speed);
+}
+
+esp_err_t app_driver_home(void)
+{
+    homing_config_t cfg = {
+        .enc = s_enc2,
+        .drive = app_driver_home_drive,
+        .fast_speed = HOME_FAST_SPEED,
+        .slow_speed = HOME_SLOW_SPEED,
+        .backoff_ticks = HOME_BACKOFF_TICKS,
+        .home_ticks = HOME_OFFSET_TICKS,
+        .settle_ms = HOME_SETTLE_MS,
+        .timeout_ms = HOME_TIMEOUT_MS,
+    };
+    return homing_run(&cfg);
 }
 
 uint16_t app_driver_encoder_get_count(int encoder)
@@ -72,6 +185,26 @@ uint16_t app_driver_encoder_get_count(int encoder)
     return ky040_get_angle(s_enc2);
 }
 
+esp_err_t app_driver_encoder_set_notify(int encoder, TaskHandle_t task)
+{
+    if (encoder == DESIRED_ANGLE)
+    {
+        return ky040_set_notify_task(s_enc1, task);
+    }
+    return ky040_set_notify_task(s_enc2, task);
+}
+
+esp_err_t app_driver_encoder_get_latched(int encoder, int64_t *ticks)
+{
+    ky040_snapshot_t snap;
+    esp_err_t ret = ky040_get_latched(encoder == DESIRED_ANGLE ? s_enc1 : s_enc2, &snap, NULL);
+    if (ret == ESP_OK)
+    {
+        *ticks = snap.ticks;
+    }
+    return ret;
+}
+
 esp_err_t app_driver_display_angle(uint8_t current, uint8_t desired)
 {
     char snum[5];
@@ -0,0 +1,155 @@
+#include <string.h>
+
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "control_loop.h"
+#include "encoder_driver.h"
+
+#define TAG "control_loop"
+
+#define CONTROL_TIMER_HZ    1000000     // gptimer resolution, 1 us
+#define CONTROL_STACK       4096
+
+static gptimer_handle_t s_timer = NULL;
+static TaskHandle_t s_task = NULL;
+static control_loop_config_t s_cfg;
+static uint32_t s_period_us;
+
+// Shared by the alarm ISR and the control task
+static volatile bool s_busy = false;
+static volatile bool s_stop = false;
+static volatile uint32_t s_seq = 0;
+static volatile int64_t s_alarm_us = 0;
+static control_loop_stats_t s_stats;
+
+static bool IRAM_ATTR _on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    if (s_busy)
+    {
+        s_stats.missed++;
+        return false;
+    }
+    ky040_latch_all();
+    s_alarm_us = esp_timer_get_time();
+    s_seq++;
+    s_busy = true;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_task, &woken);
+    return woken == pdTRUE;
+}
+
+static void _control_task(void *arg)
+{
+    control_cycle_t cycle = {
+        .dt_us = s_period_us,
+    };
+    while (!s_stop)
+    {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) == 0)
+        {
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        cycle.seq = s_seq;
+        cycle.latch_us = s_alarm_us;
+        s_cfg.step(&cycle, s_cfg.ctx);
+
+        uint32_t wake = (uint32_t)(start - cycle.latch_us);
+        uint32_t exec = (uint32_t)(esp_timer_get_time() - start);
+        if (wake > s_stats.wake_us_max)
+            s_stats.wake_us_max = wake;
+        if (exec > s_stats.exec_us_max)
+            s_stats.exec_us_max = exec;
+        s_stats.cycles++;
+        s_busy = false;
+    }
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t control_loop_start(const control_loop_config_t *cfg)
+{
+    if (!cfg || !cfg->step || cfg->rate_hz < CONTROL_RATE_MIN_HZ || cfg->rate_hz > CONTROL_RATE_MAX_HZ)
+        return ESP_ERR_INVALID_ARG;
+    if (s_timer)
+        return ESP_ERR_INVALID_STATE;
+
+    s_cfg = *cfg;
+    s_period_us = CONTROL_TIMER_HZ / cfg->rate_hz;
+    s_busy = false;
+    s_stop = false;
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    UBaseType_t prio = cfg->priority ? cfg->priority : configMAX_PRIORITIES - 1;
+    if (xTaskCreate(_control_task, "control", CONTROL_STACK, NULL, prio, &s_task) != pdPASS)
+        return ESP_ERR_NO_MEM;
+
+    gptimer_config_t timer_cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = CONTROL_TIMER_HZ,
+    };
+    gptimer_alarm_config_t alarm_cfg = {
+        .alarm_count = s_period_us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = _on_alarm,
+    };
+    esp_err_t ret = gptimer_new_timer(&timer_cfg, &s_timer);
+    if (ret == ESP_OK)
+        ret = gptimer_set_alarm_action(s_timer, &alarm_cfg);
+    if (ret == ESP_OK)
+        ret = gptimer_register_event_callbacks(s_timer, &cbs, NULL);
+    if (ret == ESP_OK)
+        ret = gptimer_enable(s_timer);
+    if (ret == ESP_OK)
+        ret = gptimer_start(s_timer);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "gptimer: %s", esp_err_to_name(ret));
+        control_loop_stop();
+        return ret;
+    }
+    ESP_LOGI(TAG, "%lu Hz, dt %lu us", (unsigned long)cfg->rate_hz, (unsigned long)s_period_us);
+    return ESP_OK;
+}
+
+esp_err_t control_loop_stop(void)
+{
+    if (s_timer)
+    {
+        gptimer_stop(s_timer);
+        gptimer_disable(s_timer);
+        gptimer_del_timer(s_timer);
+        s_timer = NULL;
+    }
+    // The task leaves at its next wait timeout
+    s_stop = true;
+    while (s_task)
+        vTaskDelay(1);
+    return ESP_OK;
+}
+
+bool control_loop_running(void)
+{
+    return s_task != NULL;
+}
+
+void control_loop_get_stats(control_loop_stats_t *out)
+{
+    *out = s_stats;
+}
+
+void control_loop_reset_stats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "homing.h"
+
+#define TAG "homing"
+
+// Switch input is active low (pull-up, falling edge latches)
+#define HOMING_SW_ACTIVE 0
+
+static void _stop(const homing_config_t *cfg)
+{
+    cfg->drive(0, 0, cfg->ctx);
+    vTaskDelay(pdMS_TO_TICKS(cfg->settle_ms));
+}
+
+// Drive until the armed index latches
+static esp_err_t _approach(const homing_config_t *cfg, uint32_t speed, int64_t *index)
+{
+    ESP_RETURN_ON_ERROR(ky040_arm_index(cfg->enc), TAG, "arm index");
+    cfg->drive(+1, speed, cfg->ctx);
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)cfg->timeout_ms * 1000;
+    while (ky040_get_index(cfg->enc, index, NULL) != ESP_OK)
+    {
+        if (esp_timer_get_time() > deadline)
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+    return ESP_OK;
+}
+
+// Drive away until the switch is released and the shaft is backoff_ticks
+// past the reference position
+static esp_err_t _back_off(const homing_config_t *cfg, uint32_t speed, int64_t from)
+{
+    cfg->drive(-1, speed, cfg->ctx);
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)cfg->timeout_ms * 1000;
+    for (;;)
+    {
+        int64_t moved = llabs(ky040_get_position(cfg->enc) - from);
+        if (moved >= cfg->backoff_ticks && ky040_get_sw_level(cfg->enc) != HOMING_SW_ACTIVE)
+            return ESP_OK;
+        if (esp_timer_get_time() > deadline)
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+}
+
+esp_err_t homing_run(const homing_config_t *cfg)
+{
+    if (!cfg || !cfg->enc || !cfg->drive)
+        return ESP_ERR_INVALID_ARG;
+    if (ky040_get_sw_level(cfg->enc) < 0)
+        return ESP_ERR_NOT_SUPPORTED;
+
+    esp_err_t ret = ESP_OK;
+    int64_t index = 0;
+
+    // Started on the switch: no falling edge to catch, clear it first
+    if (ky040_get_sw_level(cfg->enc) == HOMING_SW_ACTIVE)
+    {
+        ret = _back_off(cfg, cfg->slow_speed, ky040_get_position(cfg->enc));
+        _stop(cfg);
+        if (ret != ESP_OK)
+            goto out;
+    }
+
+    ret = _approach(cfg, cfg->fast_speed, &index);
+    _stop(cfg);
+    if (ret != ESP_OK)
+        goto out;
+
+    ret = _back_off(cfg, cfg->slow_speed, index);
+    _stop(cfg);
+    if (ret != ESP_OK)
+        goto out;
+
+    ret = _approach(cfg, cfg->slow_speed, &index);
+    cfg->drive(0, 0, cfg->ctx);
+    if (ret != ESP_OK)
+        goto out;
+
+    // Ticks counted since the edge are kept: only the reference moves
+    ky040_shift_position(cfg->enc, cfg->home_ticks - index);
+    ESP_LOGI(TAG, "homed: edge at %lld ticks -> %lld", (long long)index, (long long)cfg->home_ticks);
+    return ESP_OK;
+
+out:
+    cfg->drive(0, 0, cfg->ctx);
+    ESP_LOGE(TAG, "homing failed: %s", esp_err_to_name(ret));
+    return ret;
+}
@@ -2,6 +2,8 @@
 #define __APP_DRIVER_H__
 
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 // Cấu hình I2C cho OLED
 #define I2C_MASTER_SDA_IO       2        // Change to your SDA pin
@@ -11,21 +13,70 @@
 #define MOTOR_PWM_PIN 1
 #define MOTOR_FORWARD_PIN 5
 #define MOTOR_BACKWARD_PIN 6
+// Kênh/timer LEDC riêng cho từng trục (mỗi motor một kênh)
+#define MOTOR_LEDC_CHANNEL LEDC_CHANNEL_0
+#define MOTOR_LEDC_TIMER LEDC_TIMER_0
+// Tần số PWM (Hz), độ phân giải LEDC tự chọn cao nhất có thể; đổi lúc chạy
+// bằng app_driver_motor_set_pwm. Tốc độ vẫn theo thang 10 bit (0-1023).
+#define MOTOR_PWM_FREQ_HZ 5000
+// Giới hạn độ dốc duty (đơn vị duty/ms) bằng fade phần cứng LEDC, 0 = đổi duty tức thì
+#define MOTOR_MAX_SLOPE 20
+// Đảo chiều: tắt PWM, chờ dead time (us) rồi mới đổi chân chiều, 0 = đổi ngay
+#define MOTOR_DEAD_TIME_US 2000
+// Dừng motor: 1 = phanh ngắn mạch (short brake), 0 = thả trôi (coast)
+#define MOTOR_STOP_BRAKE 0
+// 1: hai chân chiều qua dedicated GPIO (đổi cả hai trong một lệnh ghi)
+#define MOTOR_DEDIC_GPIO 1
+// Bù vùng chết: duty (%) nhỏ nhất làm motor bắt đầu quay theo từng chiều
+// (ma sát tĩnh), 0 = không bù
+#define MOTOR_BREAKAWAY_FWD_PCT 30
+#define MOTOR_BREAKAWAY_BWD_PCT 30
+// 1 = tự đo duty khởi động lúc bật máy (motor nhích nhẹ hai chiều) thay cho hai giá trị trên
+#define MOTOR_COMP_CALIBRATE 0
+// Bảo vệ nhiệt I2t: cho phép vượt tải ngắn hạn, tự giảm giới hạn duty khi
+// cuộn dây nóng. 0 = tắt
+#define MOTOR_THERMAL_TAU_MS 30000   // hằng số thời gian nhiệt cuộn dây (ms)
+#define MOTOR_RATED_PCT 60           // duty liên tục cho phép khi kẹt trục (%)
+#define MOTOR_RATED_MA 0             // dòng định mức (mA), dùng khi có đo dòng
+// Đo dòng motor qua ADC liên tục (DMA), 0 = tắt
+#define MOTOR_CURRENT_SENSE 0
+// Chân ADC1 (GPIO0-4), -1 = chưa nối. Cả 5 chân đang bận (ENC2 CLK, PWM,
+// SDA, SCL, ENC1 DT): dời một chân sang GPIO8/9 để giải phóng nó trước
+#define MOTOR_SENSE_PIN -1
+#define MOTOR_SENSE_MV_PER_A 500   // hệ số khuếch đại điện trở shunt (mV/A)
+#define MOTOR_SENSE_OFFSET_MV 0
+#define MOTOR_SENSE_PER_PERIOD 4   // số mẫu mỗi chu kỳ PWM
+
+#if MOTOR_CURRENT_SENSE && MOTOR_SENSE_PIN < 0
+#error "MOTOR_CURRENT_SENSE cần một chân ADC1: đặt MOTOR_SENSE_PIN"
+#endif
 
 //--- Encoder #1 (phản hồi) ---
 #define ENC1_CLK_GPIO           7
 #define ENC1_DT_GPIO            4
 #define ENC1_SW_GPIO            -1
 #define ENC1_REVERSE_DIR        0   // 1 để đảo chiều cho encoder #1
+#define ENC1_DECODE_MODE        KY040_DECODE_X1
 
 // --- Encoder #2 (phản hồi) ---
 #define ENC2_CLK_GPIO           0
 #define ENC2_DT_GPIO            10
 #define ENC2_SW_GPIO            -1
 #define ENC2_REVERSE_DIR        0   // 1 để đảo chiều cho encoder #2
+// KY040_DECODE_X4: bắt cả 2 sườn CLK/DT, độ phân giải x4, bỏ qua debounce
+#define ENC2_DECODE_MODE        KY040_DECODE_X1
 
-// Debounce cạnh CLK (us)
+// Debounce cạnh CLK (us): cửa sổ cố định, hoặc giới hạn trên khi thích nghi
 #define ENCODER_DEBOUNCE_US     1500
+// 1: debounce thích nghi theo tốc độ cho cả 2 encoder, cửa sổ = 1/4 chu kỳ cạnh,
+// giới hạn trong [MIN, ENCODER_DEBOUNCE_US] (us), bắt đầu từ MIN
+#define ENCODER_DEBOUNCE_ADAPTIVE 1
+// Phải dài hơn thời gian rung tiếp điểm, nếu không cửa sổ sẽ co lại theo rung
+#define ENCODER_DEBOUNCE_MIN_US 300
+// KY040_FILTER_HW: lọc nhiễu bằng glitch filter phần cứng, bỏ debounce trong ISR
+#define ENCODER_FILTER          KY040_FILTER_SOFT
+// 1: một ngắt GPIO chung cho mọi encoder (đọc thanh ghi 1 lần), 0: ISR service của IDF
+#define ENCODER_BATCHED_ISR     0
 // Bắt sườn lên để giảm rung
 #define CLK_INTR_TYPE           GPIO_INTR_POSEDGE
 
@@ -34,6 +85,30 @@
 #define ANGLE_MAX               90
 #define ANGLE_SPAN              (ANGLE_MAX - ANGLE_MIN + 1)  // 91
 
+// ==== HOMING (encoder #2 SW nối công tắc home/limit) ====
+// 1: về gốc khi khởi động (tìm nhanh, lùi ra, tiếp cận chậm), SW của encoder #2 thành ngõ vào index
+#define HOMING_ENABLE           0
+#define HOME_DIR_FORWARD        0      // chiều motor hướng về công tắc
+#define HOME_FAST_SPEED         600    // duty 0..1023
+#define HOME_SLOW_SPEED         250
+#define HOME_BACKOFF_TICKS      5
+#define HOME_OFFSET_TICKS       0      // vị trí gán cho cạnh công tắc
+#define HOME_SETTLE_MS          100
+#define HOME_TIMEOUT_MS         10000
+
+#if HOMING_ENABLE && ENC2_SW_GPIO < 0
+#error "HOMING_ENABLE cần công tắc home: đặt ENC2_SW_GPIO"
+#endif
+
+// ==== VÒNG ĐIỀU KHIỂN (gptimer) ====
+#define CONTROL_RATE_HZ         1000   // 500..10000 Hz, dt cố định = 1/CONTROL_RATE_HZ
+#define CONTROL_KP              15.0f
+#define CONTROL_KI              0.5f   // theo giây
+#define CONTROL_KD              0.5f   // giây
+#define CONTROL_D_FILTER_US     10000  // lọc thông thấp cho khâu D
+// 1: đo số chu kỳ CPU mỗi bước PID (float so với fixed-point) lúc khởi động
+#define CONTROL_PID_BENCH       0
+
 // Độ dài queue theo phác thảo
 #define Q_DEPTH  
 
@@ -54,8 +129,23 @@ void app_driver_init(void);
 esp_err_t app_driver_motor_set_speed(uint8_t speed);
 esp_err_t app_driver_motor_set_direction(bool direction);
 esp_err_t app_driver_motor_stop(void);
+// Lệnh mô-men Q15 (-32768..32768, dấu = chiều) qua bảng bù vùng chết
+esp_err_t app_driver_motor_set_torque(int32_t torque);
+// Tự hiệu chuẩn bảng bù theo encoder phản hồi
+esp_err_t app_driver_motor_calibrate(void);
+// Dùng trong vòng điều khiển (ISR-safe, không ramp)
+esp_err_t app_driver_motor_apply_torque(int32_t torque);
+// Đổi tần số PWM khi đang chạy (chỉnh tổn hao đóng cắt / tiếng ồn tại hiện trường).
+// Phải dừng vòng điều khiển trước (control_loop_stop), nếu không trả về ESP_ERR_INVALID_STATE
+esp_err_t app_driver_motor_set_pwm(uint32_t freq_hz);
+// Về gốc encoder phản hồi, gọi trước khi chạy các task điều khiển
+esp_err_t app_driver_home(void);
 
 uint16_t app_driver_encoder_get_count(int);
+// Đánh thức task (xTaskNotifyGive) khi encoder thay đổi
+esp_err_t app_driver_encoder_set_notify(int encoder, TaskHandle_t task);
+// Số xung encoder tại lần chốt gần nhất của vòng điều khiển (ky040_latch_all)
+esp_err_t app_driver_encoder_get_latched(int encoder, int64_t *ticks);
 
 // SSD1306_t* app_driver_get_oled_device(void);
 
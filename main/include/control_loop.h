@@ -0,0 +1,57 @@
+#ifndef __CONTROL_LOOP_H__
+#define __CONTROL_LOOP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define CONTROL_RATE_MIN_HZ 500
+#define CONTROL_RATE_MAX_HZ 10000
+
+// One control cycle. The encoders were latched (ky040_latch_all) at the
+// timer alarm: read them with ky040_get_latched.
+typedef struct
+{
+    uint32_t seq;               // cycle number
+    uint32_t dt_us;             // fixed period, use it as the controller dt
+    int64_t latch_us;           // esp_timer time of the latch
+} control_cycle_t;
+
+typedef void (*control_step_fn_t)(const control_cycle_t *cycle, void *ctx);
+
+typedef struct
+{
+    uint32_t rate_hz;           // CONTROL_RATE_MIN_HZ .. CONTROL_RATE_MAX_HZ
+    control_step_fn_t step;     // runs in the control task, must finish within the period
+    void *ctx;
+    UBaseType_t priority;       // control task, 0 = configMAX_PRIORITIES - 1
+} control_loop_config_t;
+
+typedef struct
+{
+    uint32_t cycles;            // steps run
+    uint32_t missed;            // alarms that found the previous step still running
+    uint32_t exec_us_max;       // longest step
+    uint32_t wake_us_max;       // longest alarm to step start
+} control_loop_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A gptimer alarm at rate_hz latches the encoders in its ISR and notifies
+// the control task, which runs step. A missed deadline skips that cycle:
+// the step is never run twice back to back to catch up.
+esp_err_t control_loop_start(const control_loop_config_t *cfg);
+esp_err_t control_loop_stop(void);
+bool control_loop_running(void);
+void control_loop_get_stats(control_loop_stats_t *out);
+void control_loop_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CONTROL_LOOP_H__
@@ -0,0 +1,39 @@
+#ifndef __HOMING_H__
+#define __HOMING_H__
+
+#include "esp_err.h"
+#include "encoder_driver.h"
+
+// Motor output for the homing routine. dir: +1 toward the switch, -1 away.
+// speed 0 = stop.
+typedef esp_err_t (*homing_drive_fn_t)(int dir, uint32_t speed, void *ctx);
+
+typedef struct
+{
+    ky040_handle_t enc;         // feedback encoder, SW pin = home switch (KY040_SW_INDEX)
+    homing_drive_fn_t drive;
+    void *ctx;
+    uint32_t fast_speed;        // seek
+    uint32_t slow_speed;        // back-off and re-approach
+    uint32_t backoff_ticks;     // distance cleared past the switch before the slow pass
+    int64_t home_ticks;         // position assigned to the switch edge
+    uint32_t settle_ms;         // stop time between phases
+    uint32_t timeout_ms;        // per phase
+} homing_config_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Blocking: fast seek to the switch, back off, slow re-approach. The encoder
+// count at the slow-pass edge is latched in the ISR and becomes home_ticks.
+// Distances use ky040_get_position, so backoff_ticks must stay well inside
+// the angle span unless the encoder is multi_turn. The motor is stopped on
+// return, also on error (ESP_ERR_TIMEOUT when a phase does not finish).
+esp_err_t homing_run(const homing_config_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HOMING_H__